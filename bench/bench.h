@@ -0,0 +1,50 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// calls fn until at least min_seconds have elapsed (and at least once), returns the average nanoseconds per call
+template <typename F> double measure(F fn, double min_seconds=.5) {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+    long ncalls = 0;
+    double elapsed = 0;
+    do {
+        fn();
+        ncalls++;
+        elapsed = std::chrono::duration<double>(clock::now()-start).count();
+    } while (elapsed<min_seconds);
+    return elapsed*1e9/ncalls;
+}
+
+inline void report(const char *name, double ns) {
+    printf("%-40s %14.0f ns/op\n", name, ns);
+}
+
+// ns per call of an operation that covers the given pixels and triangles, the rates are left out when 0
+inline void report(const char *name, double ns, double pixels, double triangles) {
+    printf("%-40s %14.0f ns/op", name, ns);
+    if (pixels>0)    printf(" %10.2f Mpixels/s", pixels*1e3/ns);
+    if (triangles>0) printf(" %10.3f Mtriangles/s", triangles*1e3/ns);
+    printf("\n");
+}
+
+// the deterministic scene used when no model is given: a bumpy uv-mapped sphere of about 2*n*n triangles
+// written as <dir>/synthetic.obj, with copies of the shipped african_head textures next to it
+std::string make_scene(const std::string &dir, int n);
+
+void bench_geometry();
+void bench_raster(int width, int height);
+void bench_io(const std::string &scene);
+void bench_shaders(int width, int height);
+void bench_bvh(int width, int height);
+void bench_lod();
+void bench_reorder(const std::string &filename, int width, int height);
+void bench_instancing(int width, int height);
+void bench_msaa(int width, int height);
+void bench_shadow(int width, int height, int size);
+
+#endif //__BENCH_H__
+
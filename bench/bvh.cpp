@@ -0,0 +1,68 @@
+#include <vector>
+#include "bench.h"
+#include "bvh.h"
+#include "shaders.h"
+
+static Matrix camera(Vec3f eye, Vec3f center, int width, int height) {
+    lookat(eye, center, Vec3f(0, 1, 0));
+    viewport(width/8, height/8, width*3/4, height*3/4);
+    projection(-1.f/(eye-center).norm());
+    return Viewport*Projection*ModelView;
+}
+
+void bench_bvh(int width, int height) {
+    BVH bvh;
+    report("BVH build", measure([&]() { bvh.build(*model, ThreadPool::shared()); }), 0, model->nfaces());
+
+    TGAImage image(width, height, TGAImage::RGB);
+    DepthBuffer zbuffer(width, height);
+    std::vector<Vec4f> verts;
+    std::vector<float> intensity(model->nnormals());
+    for (int i=0; i<model->nnormals(); i++) {
+        intensity[i] = std::max(0.f, model->normal(i)*light_dir);
+    }
+    GouraudShader shader;
+    shader.uniform_model     = model;
+    shader.uniform_intensity = intensity.data();
+
+    std::vector<int> all(model->nfaces()), faces;
+    for (int i=0; i<model->nfaces(); i++) all[i] = i;
+    auto frame = [&](const Matrix &m, const std::vector<int> &faces) {
+        image.clear();
+        zbuffer.clear();
+        transform_vertices(*model, m, verts);
+        shader.uniform_verts = verts.data();
+        for (size_t k=0; k<faces.size(); k++) {
+            Vec4f screen_coords[3];
+            for (int j=0; j<3; j++) screen_coords[j] = shader.vertex(faces[k], j);
+            triangle(screen_coords, shader, image, zbuffer);
+        }
+    };
+
+    // the whole model, then closer and closer to the surface of the synthetic sphere (radius .7); the field
+    // of view depends on the eye to center distance, the center stays 3 units away so that it does not widen
+    const char *names[] = {"whole model", "eye near the surface", "eye on the surface"};
+    const Vec3f eyes[] = {Vec3f(.9f, .3f, 3.f), Vec3f(.1f, .05f, 1.2f), Vec3f(.02f, .01f, .8f)};
+    const Vec3f centers[] = {Vec3f(0, 0, 0), Vec3f(0, 0, -1.8f), Vec3f(0, 0, -2.2f)};
+    for (int i=0; i<3; i++) {
+        Matrix m = camera(eyes[i], centers[i], width, height);
+        char name[64];
+        snprintf(name, sizeof(name), "BVH cull, %s", names[i]);
+        report(name, measure([&]() { faces.clear(); bvh.cull(m, Vec2i(width, height), faces); }), 0, model->nfaces());
+        double whole = measure([&]() { frame(m, all); });
+        double culled = measure([&]() { faces.clear(); bvh.cull(m, Vec2i(width, height), faces); frame(m, faces); });
+        printf("  frame %10.3f ms   culled frame (%3d%% of the faces) %10.3f ms   speedup %.2fx\n", whole*1e-6, (int)(100.*faces.size()/model->nfaces()), culled*1e-6, whole/culled);
+    }
+
+    Matrix m = camera(eyes[0], centers[0], width, height);
+    const int step = 16;
+    double ns = measure([&]() {
+        for (int y=0; y<height; y+=step) {
+            for (int x=0; x<width; x+=step) {
+                BVH::Hit hit;
+                bvh.pick(m, Vec2f(x, y), hit);
+            }
+        }
+    });
+    report("BVH pick (ns per ray)", ns/((width/step)*(height/step)));
+}
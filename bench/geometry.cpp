@@ -0,0 +1,81 @@
+#include <vector>
+#include <random>
+#include "bench.h"
+#include "geometry.h"
+#include "our_gl.h"
+
+const int N = 1024; // inputs per measured call
+
+template <typename T> static void sink(const T &v) {
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+void bench_geometry() {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> u(-1.f, 1.f);
+    std::vector<Vec3f> a(N), b(N);
+    std::vector<Vec4f> p(N);
+    std::vector<Vec2f> q(N);
+    std::vector<Matrix> m(N);
+    for (int i=0; i<N; i++) {
+        a[i] = Vec3f(u(rng), u(rng), u(rng));
+        b[i] = Vec3f(u(rng), u(rng), u(rng));
+        p[i] = embed<4>(Vec3f(u(rng), u(rng), u(rng)));
+        q[i] = Vec2f(u(rng)*100, u(rng)*100);
+        for (int r=0; r<4; r++) for (int c=0; c<4; c++) m[i][r][c] = u(rng) + (r==c ? 2 : 0);
+    }
+    Vec2f A(-100, -100), B(100, -80), C(-10, 100);
+
+    report("barycentric", measure([&]() {
+        for (int i=0; i<N; i++) sink(barycentric(A, B, C, q[i]));
+    })/N);
+    report("Vec3f dot", measure([&]() {
+        for (int i=0; i<N; i++) sink(a[i]*b[i]);
+    })/N);
+    report("Vec3f cross", measure([&]() {
+        for (int i=0; i<N; i++) sink(cross(a[i], b[i]));
+    })/N);
+    report("Vec3f normalize", measure([&]() {
+        for (int i=0; i<N; i++) { Vec3f v = a[i]; sink(v.normalize()); }
+    })/N);
+    report("Vec3f add/sub/scale", measure([&]() {
+        for (int i=0; i<N; i++) sink((a[i]+b[i])*.5f - a[i]);
+    })/N);
+    report("embed/proj", measure([&]() {
+        for (int i=0; i<N; i++) sink(proj<3>(embed<4>(a[i])));
+    })/N);
+    report("Matrix*Vec4f", measure([&]() {
+        for (int i=0; i<N; i++) sink(m[i]*p[i]);
+    })/N);
+    report("Matrix*Matrix", measure([&]() {
+        for (int i=0; i<N; i++) sink(m[i]*m[(i+1)%N]);
+    })/N);
+    report("Matrix det", measure([&]() {
+        for (int i=0; i<N; i++) sink(m[i].det());
+    })/N);
+    report("Matrix invert_transpose", measure([&]() {
+        for (int i=0; i<N; i++) sink(m[i].invert_transpose());
+    })/N);
+    report("Matrix invert", measure([&]() {
+        for (int i=0; i<N; i++) sink(m[i].invert());
+    })/N);
+
+    // a whole vertex stage: one matrix over the model arrays, per point and batched
+    std::vector<float> x(N), y(N), z(N), ox(N), oy(N), oz(N);
+    std::vector<Vec4f> out(N);
+    for (int i=0; i<N; i++) {
+        x[i] = a[i].x; y[i] = a[i].y; z[i] = a[i].z;
+    }
+    report("Matrix*Vec4f per point", measure([&]() {
+        for (int i=0; i<N; i++) out[i] = m[0]*embed<4>(Vec3f(x[i], y[i], z[i]));
+        sink(out[0]);
+    })/N);
+    report("transform_points", measure([&]() {
+        transform_points(m[0], x.data(), y.data(), z.data(), N, out.data());
+        sink(out[0]);
+    })/N);
+    report("transform_directions", measure([&]() {
+        transform_directions(m[0], x.data(), y.data(), z.data(), N, ox.data(), oy.data(), oz.data());
+        sink(ox[0]);
+    })/N);
+}
@@ -0,0 +1,74 @@
+#include <vector>
+#include <cmath>
+#include "bench.h"
+#include "instancing.h"
+#include "shaders.h"
+
+// a side x side crowd of the model around the origin, seen from above and from afar
+void bench_instancing(int width, int height) {
+    const int side = 8, n = side*side;
+    std::vector<Matrix> transforms(n);
+    for (int i=0; i<n; i++) {
+        float angle = 2*M_PI*i/n;
+        Matrix &t = transforms[i];
+        t = Matrix::identity();
+        t[0][0] =  std::cos(angle); t[0][2] = std::sin(angle);
+        t[2][0] = -std::sin(angle); t[2][2] = std::cos(angle);
+        t[0][3] = 2.5f*(i%side)-1.25f*(side-1);
+        t[2][3] = 2.5f*(i/side)-1.25f*(side-1);
+    }
+    Vec3f eye(0, 14, 18), center(0, 0, 5), up(0, 1, 0); // the far rows are out of the view
+    DrawContext ctx(lookat_matrix(eye, center, up), projection_matrix(-1.f/(eye-center).norm()), viewport_matrix(width/8, height/8, width*3/4, height*3/4));
+    light_dir.normalize();
+    TGAImage image(width, height, TGAImage::RGB);
+    DepthBuffer zbuffer(width, height);
+
+    // the way main.cpp would do it: the globals set up again and the normals lit in world space per instance
+    std::vector<Vec4f> verts;
+    std::vector<float> intensity(model->nnormals());
+    double naive = measure([&]() {
+        image.clear();
+        zbuffer.clear();
+        for (int k=0; k<n; k++) {
+            lookat(eye, center, up);
+            ModelView = ModelView*transforms[k];
+            projection(-1.f/(eye-center).norm());
+            viewport(width/8, height/8, width*3/4, height*3/4);
+            Matrix it = transforms[k].invert_transpose();
+            for (int i=0; i<model->nnormals(); i++) intensity[i] = std::max(0.f, proj<3>(it*embed<4>(model->normal(i), 0.f)).normalize()*light_dir);
+            transform_vertices(*model, Viewport*Projection*ModelView, verts);
+            GouraudShader shader;
+            shader.uniform_model     = model;
+            shader.uniform_verts     = verts.data();
+            shader.uniform_intensity = intensity.data();
+            for (int i=0; i<model->nfaces(); i++) {
+                Vec4f screen_coords[3];
+                for (int j=0; j<3; j++) screen_coords[j] = shader.GouraudShader::vertex(i, j);
+                triangle(screen_coords, shader, image, zbuffer);
+            }
+        }
+    });
+
+    // lit in object space, once per instance outside of the frame
+    std::vector<float> intensities(n*model->nnormals());
+    for (int k=0; k<n; k++) {
+        Vec3f light = object_direction(transforms[k], light_dir);
+        for (int i=0; i<model->nnormals(); i++) intensities[k*model->nnormals()+i] = std::max(0.f, model->normal(i)*light);
+    }
+    GouraudShader shader;
+    shader.uniform_model = model;
+    auto setup = [&](int k, GouraudShader &s, const Vec4f *v) {
+        s.uniform_verts     = v;
+        s.uniform_intensity = &intensities[k*model->nnormals()];
+    };
+    auto instanced = [&](ThreadPool *pool, float lod_error) {
+        image.clear();
+        zbuffer.clear();
+        draw_instanced(*model, ctx, transforms, shader, setup, image, zbuffer, pool, lod_error);
+    };
+    double serial = measure([&]() { instanced(NULL, 0); });
+    double pooled = measure([&]() { instanced(&ThreadPool::shared(), 0); });
+    double lod    = measure([&]() { instanced(NULL, 1); });
+    printf("crowd of %d: per instance %10.3f ms   draw_instanced %10.3f ms (%.2fx)   on the pool %10.3f ms (%.2fx)   with lod %10.3f ms (%.2fx)\n",
+           n, naive*1e-6, serial*1e-6, naive/serial, pooled*1e-6, naive/pooled, lod*1e-6, naive/lod);
+}
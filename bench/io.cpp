@@ -0,0 +1,37 @@
+#include <cstdio>
+#include <string>
+#include "bench.h"
+#include "model.h"
+#include "objparser.h"
+#include "mappedfile.h"
+
+void bench_io(const std::string &scene) {
+    std::string cache = scene + ".mesh";
+    Model probe(scene.c_str());
+    double ntris = probe.nfaces();
+    MappedFile obj;
+    if (obj.open(scene.c_str())) {
+        report("parse_obj", measure([&]() {
+            ObjData data;
+            parse_obj(obj.data(), obj.size(), data, ThreadPool::shared());
+        }), 0, ntris);
+    }
+    report("Model load, obj parse", measure([&]() {
+        remove(cache.c_str());
+        Model m(scene.c_str());
+    }), 0, ntris);
+    report("Model load, mesh cache hit", measure([&]() {
+        Model m(scene.c_str());
+    }), 0, ntris);
+
+    TGAImage img;
+    if (!img.read_tga_file("obj/african_head_diffuse.tga")) return;
+    double npixels = (double)img.get_width()*img.get_height();
+    std::string rle = scene + ".rle.tga", raw = scene + ".raw.tga";
+    report("TGA write rle", measure([&]() { img.write_tga_file(rle.c_str(), true);  }), npixels, 0);
+    report("TGA write raw", measure([&]() { img.write_tga_file(raw.c_str(), false); }), npixels, 0);
+    report("TGA read rle",  measure([&]() { TGAImage t; t.read_tga_file(rle.c_str()); }), npixels, 0);
+    report("TGA read raw",  measure([&]() { TGAImage t; t.read_tga_file(raw.c_str()); }), npixels, 0);
+    remove(rle.c_str());
+    remove(raw.c_str());
+}
@@ -0,0 +1,54 @@
+#include <vector>
+#include "bench.h"
+#include "simplify.h"
+#include "shaders.h"
+
+void bench_lod() {
+    // the chain again from the arrays of level 0, as load_obj() does on a cache miss
+    std::vector<Vec3f> verts(model->nverts());
+    for (int i=0; i<model->nverts(); i++) verts[i] = model->vert(i);
+    Span<const int> vidx = model->vert_indices(), tidx = model->uv_indices(), nidx = model->normal_indices();
+    std::vector<Vec3i> level0(model->nfaces()*3), corners;
+    for (int i=0; i<model->nfaces()*3; i++) level0[i] = Vec3i(vidx[i], tidx[i], nidx[i]);
+    std::vector<LodLevel> levels;
+    report("LOD chain build", measure([&]() { corners = level0; build_lod_chain(verts, corners, levels); }, 0), 0, model->nfaces());
+    for (int i=0; i<model->nlods(); i++) {
+        printf("  level %d %8d faces   error %g\n", i, model->lod_nfaces(i), model->lod_error(i));
+    }
+
+    std::vector<float> intensity(model->nnormals());
+    for (int i=0; i<model->nnormals(); i++) {
+        intensity[i] = std::max(0.f, model->normal(i)*light_dir);
+    }
+    std::vector<Vec4f> screen;
+    GouraudShader shader;
+    shader.uniform_model     = model;
+    shader.uniform_intensity = intensity.data();
+
+    // thumbnails, where the model itself is mostly subpixel triangles
+    const int sizes[] = {64, 128, 256};
+    for (int s=0; s<3; s++) {
+        int size = sizes[s];
+        TGAImage image(size, size, TGAImage::RGB);
+        DepthBuffer zbuffer(size, size);
+        lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+        viewport(size/8, size/8, size*3/4, size*3/4);
+        projection(-1.f/Vec3f(1, 1, 3).norm());
+        Matrix m = Viewport*Projection*ModelView;
+        int level = model->select_lod(m);
+        auto frame = [&](int level) {
+            image.clear();
+            zbuffer.clear();
+            transform_vertices(*model, m, screen);
+            shader.uniform_verts = screen.data();
+            for (int i=model->lod_first_face(level); i<model->lod_first_face(level)+model->lod_nfaces(level); i++) {
+                Vec4f screen_coords[3];
+                for (int j=0; j<3; j++) screen_coords[j] = shader.vertex(i, j);
+                triangle(screen_coords, shader, image, zbuffer);
+            }
+        };
+        double full = measure([&]() { frame(0); });
+        double lod  = measure([&]() { frame(level); });
+        printf("  %3dx%-3d frame %8.3f ms   level %d (%7d faces) %8.3f ms   speedup %.2fx\n", size, size, full*1e-6, level, model->lod_nfaces(level), lod*1e-6, full/lod);
+    }
+}
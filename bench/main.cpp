@@ -0,0 +1,34 @@
+#include <iostream>
+#include <filesystem>
+#include "bench.h"
+#include "model.h"
+#include "shaders.h"
+
+// tinyrenderer_bench [model.obj], without a model the synthetic scene is generated in the temp directory.
+// Run it from the build directory (it reads obj/), the loaders log to stderr: 2>/dev/null keeps the table clean.
+int main(int argc, char** argv) {
+    std::string scene = make_scene(std::filesystem::temp_directory_path().string(), 128);
+    if (scene.empty()) {
+        std::cerr << "can't write the synthetic scene" << std::endl;
+        return 1;
+    }
+    std::string filename = 2==argc ? argv[1] : scene;
+    model = new Model(filename.c_str());
+    if (0==model->nfaces()) {
+        std::cerr << "no faces to render" << std::endl;
+        delete model;
+        return 1;
+    }
+    bench_geometry();
+    bench_raster(800, 800);
+    bench_io(scene);
+    bench_shaders(800, 800);
+    bench_bvh(800, 800);
+    bench_lod();
+    bench_reorder(filename, 800, 800);
+    bench_instancing(800, 800);
+    bench_msaa(800, 800);
+    bench_shadow(800, 800, 1024);
+    delete model;
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <vector>
+#include "bench.h"
+#include "msaa.h"
+#include "shaders.h"
+
+// S that counts its fragment calls
+template <typename S> struct Counting : public S {
+    long calls;
+    virtual bool fragment(Vec3f bar, TGAColor &color) {
+        calls++;
+        return S::fragment(bar, color);
+    }
+};
+
+// the vertex transform by m and every face of the model through draw(pts, shader), returns the fragment calls
+template <typename S, typename D> static long frame(Counting<S> shader, const Matrix &m, std::vector<Vec4f> &verts, D draw) {
+    transform_vertices(*model, m, verts);
+    shader.calls = 0;
+    shader.uniform_verts = verts.data();
+    for (int i=0; i<model->nfaces(); i++) {
+        Vec4f screen_coords[3];
+        for (int j=0; j<3; j++) screen_coords[j] = shader.Counting<S>::vertex(i, j);
+        draw(screen_coords, shader);
+    }
+    return shader.calls;
+}
+
+// 2x2 supersampling shrunk by TGAImage::scale() against multisampling, with shader
+template <typename S> static void compare(const char *name, const Counting<S> &shader, const Matrix &camera, int width, int height) {
+    Matrix m1 = viewport_matrix(width/8, height/8, width*3/4, height*3/4)*camera;
+    Matrix m2 = viewport_matrix(width/4, height/4, width*3/2, height*3/2)*camera;
+    std::vector<Vec4f> verts;
+    TGAImage image(width, height, TGAImage::RGB), big(width*2, height*2, TGAImage::RGB);
+    DepthBuffer zbuffer(width, height), bigz(width*2, height*2);
+    long fragments = 0;
+    typedef Counting<S> C;
+
+    double ns = measure([&]() {
+        image.clear();
+        zbuffer.clear();
+        fragments = frame(shader, m1, verts, [&](Vec4f *pts, C &s) { triangle(pts, s, image, zbuffer); });
+    });
+    printf("%-14s no anti-aliasing  %10.3f ms/frame %10ld fragments\n", name, ns*1e-6, fragments);
+    ns = measure([&]() {
+        big.clear();
+        bigz.clear();
+        fragments = frame(shader, m2, verts, [&](Vec4f *pts, C &s) { triangle(pts, s, big, bigz); });
+        TGAImage shrunk(big);
+        shrunk.scale(width, height);
+    });
+    printf("%-14s 2x2 supersampled  %10.3f ms/frame %10ld fragments\n", name, ns*1e-6, fragments);
+    for (int n=2; n<=8; n*=2) {
+        MultisampleBuffer msaa(width, height, n);
+        ns = measure([&]() {
+            msaa.clear();
+            fragments = frame(shader, m1, verts, [&](Vec4f *pts, C &s) { multisample_triangle(pts, s, msaa); });
+            resolve_multisample(msaa, image, ThreadPool::shared());
+        });
+        double resolve = measure([&]() { resolve_multisample(msaa, image, ThreadPool::shared()); });
+        printf("%-14s %dx multisampled   %10.3f ms/frame %10ld fragments   resolve %.3f ms\n", name, n, ns*1e-6, fragments, resolve*1e-6);
+    }
+}
+
+void bench_msaa(int width, int height) {
+    Vec3f eye(1, 1, 3), center(0, 0, 0), up(0, 1, 0);
+    Matrix camera = projection_matrix(-1.f/(eye-center).norm())*lookat_matrix(eye, center, up);
+    light_dir.normalize();
+    std::vector<float> intensity(model->nnormals());
+    for (int i=0; i<model->nnormals(); i++) intensity[i] = std::max(0.f, model->normal(i)*light_dir);
+
+    Counting<GouraudShader> gouraud;
+    gouraud.uniform_model     = model;
+    gouraud.uniform_intensity = intensity.data();
+    compare("GouraudShader", gouraud, camera, width, height);
+    Counting<Shader> phong;
+    phong.uniform_model     = model;
+    phong.uniform_light_dir = light_dir;
+    phong.uniform_M         = camera;
+    phong.uniform_MIT       = camera.invert_transpose();
+    compare("Shader", phong, camera, width, height);
+}
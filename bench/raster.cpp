@@ -0,0 +1,67 @@
+#include <vector>
+#include "bench.h"
+#include "our_gl.h"
+
+// constant color, counts what reaches the fragment stage
+struct FlatShader : public IShader {
+    long nfragments;
+    FlatShader() : nfragments(0) {}
+    virtual Vec4f vertex(int, int) { return Vec4f(); }
+    virtual bool fragment(Vec3f, TGAColor &color) {
+        nfragments++;
+        color = TGAColor(255, 255, 255);
+        return false;
+    }
+};
+
+static void add(std::vector<Vec4f> &tris, float x0, float y0, float x1, float y1, float x2, float y2) {
+    tris.push_back(embed<4>(Vec3f(x0, y0, .5f)));
+    tris.push_back(embed<4>(Vec3f(x1, y1, .5f)));
+    tris.push_back(embed<4>(Vec3f(x2, y2, .5f)));
+}
+
+// one call clears the depth buffer and draws every triangle of the set
+static void run_mode(const char *name, const std::vector<Vec4f> &tris, TGAImage &image, DepthBuffer &zbuffer) {
+    FlatShader shader;
+    std::vector<Vec4f> pts(tris);
+    auto pass = [&]() {
+        zbuffer.clear();
+        for (size_t i=0; i<pts.size(); i+=3) triangle(&pts[i], shader, image, zbuffer);
+    };
+    pass();
+    double pixels = shader.nfragments, ntris = tris.size()/3;
+    report(name, measure(pass), pixels, ntris);
+}
+
+// one call clears the depth buffer and draws every triangle of the set, in both raster modes
+static void run(const char *name, const std::vector<Vec4f> &tris, TGAImage &image, DepthBuffer &zbuffer) {
+    for (int mode=0; mode<2; mode++) {
+        rasterization(mode ? RASTER_FIXED : RASTER_FLOAT);
+        run_mode((std::string(name) + (mode ? ", fixed" : "")).c_str(), tris, image, zbuffer);
+    }
+    rasterization(RASTER_FLOAT);
+}
+
+void bench_raster(int width, int height) {
+    TGAImage image(width, height, TGAImage::RGB);
+    DepthBuffer zbuffer(width, height);
+    report("DepthBuffer clear", measure([&]() { zbuffer.clear(); }), width*height, 0);
+
+    std::vector<Vec4f> small, large, sliver;
+    const int cell = 8; // small: two triangles per 8x8 cell all over the screen
+    for (int y=0; y+cell<=height; y+=cell) {
+        for (int x=0; x+cell<=width; x+=cell) {
+            add(small, x, y, x+cell, y, x, y+cell);
+            add(small, x+cell, y, x+cell, y+cell, x, y+cell);
+        }
+    }
+    float s = .75f*std::min(width, height), ox = (width-s)/2, oy = (height-s)/2;
+    add(large, ox, oy, ox+s, oy, ox, oy+s);
+    add(large, ox+s, oy, ox+s, oy+s, ox, oy+s);
+    for (int y=0; y+48<height; y+=2) // long, about 1.5 pixel thick
+        add(sliver, 8, y, width-8, y+40, width-8, y+41.5f);
+
+    run("triangle small (8x8 halves)", small,  image, zbuffer);
+    run("triangle large (2 x 3/4 screen)", large,  image, zbuffer);
+    run("triangle sliver", sliver, image, zbuffer);
+}
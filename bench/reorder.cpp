@@ -0,0 +1,67 @@
+#include <vector>
+#include "bench.h"
+#include "reorder.h"
+#include "shaders.h"
+
+// the vertex transform and the draw of the whole model m, GouraudShader or the normal-mapped Shader
+static void frame(Model &m, bool textured, std::vector<Vec4f> &verts, const std::vector<float> &intensity, TGAImage &image, DepthBuffer &zbuffer) {
+    image.clear();
+    zbuffer.clear();
+    transform_vertices(m, Viewport*Projection*ModelView, verts);
+    GouraudShader gouraud;
+    gouraud.uniform_model     = &m;
+    gouraud.uniform_verts     = verts.data();
+    gouraud.uniform_intensity = intensity.data();
+    Shader phong;
+    phong.uniform_model     = &m;
+    phong.uniform_verts     = verts.data();
+    phong.uniform_light_dir = light_dir;
+    phong.uniform_M         =  Projection*ModelView;
+    phong.uniform_MIT       = (Projection*ModelView).invert_transpose();
+    for (int i=0; i<m.nfaces(); i++) {
+        Vec4f screen_coords[3];
+        if (textured) {
+            for (int j=0; j<3; j++) screen_coords[j] = phong.Shader::vertex(i, j);
+            triangle(screen_coords, phong, image, zbuffer);
+        } else {
+            for (int j=0; j<3; j++) screen_coords[j] = gouraud.GouraudShader::vertex(i, j);
+            triangle(screen_coords, gouraud, image, zbuffer);
+        }
+    }
+}
+
+void bench_reorder(const std::string &filename, int width, int height) {
+    Model reordered(filename.c_str(), true);
+    Model *models[2] = {model, &reordered};
+    std::vector<Vec3i> corners[2];
+    for (int k=0; k<2; k++) {
+        Span<const int> vidx = models[k]->vert_indices();
+        for (int i=0; i<models[k]->nfaces()*3; i++) corners[k].push_back(Vec3i(vidx[i], 0, 0));
+    }
+    printf("ACMR (FIFO of %d)   file order %.3f   reordered %.3f\n", VERTEX_CACHE_SIZE, acmr(corners[0], 0, model->nfaces()), acmr(corners[1], 0, reordered.nfaces()));
+    report("reorder_faces", measure([&]() {
+        std::vector<Vec3i> c(corners[0]);
+        std::vector<Vec3f> verts(model->nverts());
+        for (int i=0; i<model->nverts(); i++) verts[i] = model->vert(i);
+        reorder_faces(verts, c, 0, model->nfaces());
+    }), 0, model->nfaces());
+
+    Vec3f eye(1, 1, 3), center(0, 0, 0), up(0, 1, 0);
+    lookat(eye, center, up);
+    viewport(width/8, height/8, width*3/4, height*3/4);
+    projection(-1.f/(eye-center).norm());
+    light_dir.normalize();
+    TGAImage image(width, height, TGAImage::RGB);
+    DepthBuffer zbuffer(width, height);
+    std::vector<Vec4f> verts;
+    const char *names[] = {"GouraudShader", "Shader"};
+    for (int textured=0; textured<2; textured++) {
+        double ns[2];
+        for (int k=0; k<2; k++) {
+            std::vector<float> intensity(models[k]->nnormals());
+            for (int i=0; i<models[k]->nnormals(); i++) intensity[i] = std::max(0.f, models[k]->normal(i)*light_dir);
+            ns[k] = measure([&]() { frame(*models[k], textured, verts, intensity, image, zbuffer); });
+        }
+        printf("%-16s file order %10.3f ms/frame   reordered %10.3f ms/frame   speedup %.2fx\n", names[textured], ns[0]*1e-6, ns[1]*1e-6, ns[0]/ns[1]);
+    }
+}
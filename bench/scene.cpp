@@ -0,0 +1,35 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include "bench.h"
+#include "tgaimage.h"
+
+std::string make_scene(const std::string &dir, int n) {
+    std::string obj = dir + "/synthetic.obj";
+    FILE *f = fopen(obj.c_str(), "w");
+    if (!f) return "";
+    int nu = 2*n, nv = n;
+    for (int j=0; j<=nv; j++) {
+        for (int i=0; i<=nu; i++) {
+            float th = M_PI*j/nv, ph = 2*M_PI*i/nu;
+            float r = .7f*(1 + .08f*std::sin(5*ph)*std::sin(4*th));
+            float x = std::sin(th)*std::cos(ph), y = std::cos(th), z = std::sin(th)*std::sin(ph);
+            fprintf(f, "v %f %f %f\nvt %f %f 0.0\nvn %f %f %f\n", r*x, r*y, r*z, (float)i/nu, 1-(float)j/nv, x, y, z);
+        }
+    }
+    for (int j=0; j<nv; j++) {
+        for (int i=0; i<nu; i++) {
+            int a = j*(nu+1)+i+1, b = a+1, c = a+nu+1, d = c+1;
+            fprintf(f, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c); // counterclockwise seen from outside
+            fprintf(f, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, d, d, d, c, c, c);
+        }
+    }
+    fclose(f);
+    const char *suffixes[3] = {"_diffuse.tga", "_nm.tga", "_spec.tga"};
+    for (int i=0; i<3; i++) {
+        TGAImage img;
+        if (img.read_tga_file((std::string("obj/african_head") + suffixes[i]).c_str()))
+            img.write_tga_file((dir + "/synthetic" + suffixes[i]).c_str());
+    }
+    return obj;
+}
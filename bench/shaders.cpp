@@ -0,0 +1,88 @@
+#include <vector>
+#include "bench.h"
+#include "shaders.h"
+#include "gbuffer.h"
+
+// renders a whole frame with the static pipeline or through the IShader interface
+template <typename S> static void frame(S &shader, bool dynamic, TGAImage &image, DepthBuffer &zbuffer) {
+    image.clear();
+    zbuffer.clear();
+    IShader &ishader = shader;
+    for (int i=0; i<model->nfaces(); i++) {
+        Vec4f screen_coords[3];
+        if (dynamic) {
+            for (int j=0; j<3; j++) screen_coords[j] = ishader.vertex(i, j);
+            triangle(screen_coords, ishader, image, zbuffer);
+        } else {
+            for (int j=0; j<3; j++) screen_coords[j] = shader.S::vertex(i, j);
+            triangle(screen_coords, shader, image, zbuffer);
+        }
+    }
+}
+
+template <typename S> static void compare(const char *name, S &shader, TGAImage &image, DepthBuffer &zbuffer) {
+    double dynamic = measure([&]() { frame(shader, true,  image, zbuffer); });
+    double fixed   = measure([&]() { frame(shader, false, image, zbuffer); });
+    printf("%-16s IShader %10.3f ms/frame   triangle<S> %10.3f ms/frame   speedup %.2fx\n", name, dynamic*1e-6, fixed*1e-6, dynamic/fixed);
+}
+
+// forward frame against a geometry pass into the G-buffer followed by the shading pass on the shared pool
+template <typename S> static void compare_deferred(const char *name, S &shader, const std::vector<Vec4f> &verts, TGAImage &image, DepthBuffer &zbuffer) {
+    GBuffer gbuffer(image.get_width(), image.get_height());
+    double forward  = measure([&]() { frame(shader, false, image, zbuffer); });
+    double deferred = measure([&]() {
+        image.clear();
+        zbuffer.clear();
+        gbuffer.clear();
+        for (int i=0; i<model->nfaces(); i++) {
+            Vec4f screen_coords[3];
+            for (int j=0; j<3; j++) screen_coords[j] = verts[model->vert_index(i, j)];
+            gbuffer_triangle(screen_coords, i, gbuffer, zbuffer);
+        }
+        resolve_gbuffer(shader, gbuffer, image, ThreadPool::shared());
+    });
+    printf("%-16s forward %10.3f ms/frame   deferred    %10.3f ms/frame   speedup %.2fx\n", name, forward*1e-6, deferred*1e-6, forward/deferred);
+}
+
+void bench_shaders(int width, int height) {
+    Vec3f eye(0, 0, 3), center(0, 0, 0), up(0, 1, 0);
+    lookat(eye, center, up);
+    viewport(width/8, height/8, width*3/4, height*3/4);
+    projection(-1.f/(eye-center).norm());
+    light_dir.normalize();
+
+    TGAImage image(width, height, TGAImage::RGB);
+    DepthBuffer zbuffer(width, height);
+
+    std::vector<Vec4f> verts, cel_verts;
+    transform_vertices(*model, Viewport*Projection*ModelView, verts);
+    transform_vertices(*model, Viewport*ModelView, cel_verts);
+    std::vector<float> intensity(model->nnormals());
+    for (int i=0; i<model->nnormals(); i++) {
+        intensity[i] = std::max(0.f, model->normal(i)*light_dir);
+    }
+
+    GouraudShader gouraud;
+    gouraud.uniform_model     = model;
+    gouraud.uniform_verts     = verts.data();
+    gouraud.uniform_intensity = intensity.data();
+    compare("GouraudShader", gouraud, image, zbuffer);
+
+    CelShader cel;
+    cel.uniform_model     = model;
+    cel.uniform_verts     = cel_verts.data();
+    cel.uniform_intensity = intensity.data();
+    compare("CelShader", cel, image, zbuffer);
+
+    Shader phong;
+    phong.uniform_model     = model;
+    phong.uniform_verts     = verts.data();
+    phong.uniform_light_dir = light_dir;
+    phong.uniform_M         =  Projection*ModelView;
+    phong.uniform_MIT       = (Projection*ModelView).invert_transpose();
+    compare("Shader", phong, image, zbuffer);
+
+    compare_deferred("GouraudShader", gouraud, verts, image, zbuffer);
+    compare_deferred("Shader", phong, verts, image, zbuffer);
+}
+
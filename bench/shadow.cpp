@@ -0,0 +1,77 @@
+#include <vector>
+#include "bench.h"
+#include "shaders.h"
+#include "shadow.h"
+
+// what the depth pass replaces: a color pass through the IShader interface, the fragment does nothing
+struct DepthShader : public IShader {
+    const Vec4f *uniform_verts;
+
+    virtual Vec4f vertex(int iface, int nthvert) {
+        return uniform_verts[model->vert_index(iface, nthvert)];
+    }
+
+    virtual bool fragment(Vec3f, TGAColor &color) {
+        color = TGAColor(255, 255, 255);
+        return false;
+    }
+};
+
+// the shaded frame of the camera, with or without shadows
+static void frame(Shader &shader, TGAImage &image, DepthBuffer &zbuffer) {
+    image.clear();
+    zbuffer.clear();
+    for (int i=0; i<model->nfaces(); i++) {
+        Vec4f screen_coords[3];
+        for (int j=0; j<3; j++) screen_coords[j] = shader.Shader::vertex(i, j);
+        triangle(screen_coords, shader, image, zbuffer);
+    }
+}
+
+// the depth-only pass of a size x size shadow map against the naive pass and the shaded frame
+void bench_shadow(int width, int height, int size) {
+    Vec3f eye(1, 1, 3), center(0, 0, 0), up(0, 1, 0);
+    DrawContext ctx(lookat_matrix(eye, center, up), projection_matrix(-1.f/(eye-center).norm()), viewport_matrix(width/8, height/8, width*3/4, height*3/4));
+    light_dir.normalize();
+    ShadowMap shadow(size);
+    shadow.look(light_dir, (model->bbox_min()+model->bbox_max())*.5f, (model->bbox_max()-model->bbox_min()).norm()*.5f);
+    std::vector<Vec4f> verts, shadow_verts;
+    transform_vertices(*model, ctx.clip(), verts);
+    transform_vertices(*model, shadow.matrix(), shadow_verts);
+
+    double depth = measure([&]() {
+        shadow.clear();
+        shadow.draw(*model, shadow_verts.data());
+    });
+    TGAImage map(size, size, TGAImage::GRAYSCALE);
+    DepthBuffer mapz(size, size);
+    DepthShader naive;
+    naive.uniform_verts = shadow_verts.data();
+    double colored = measure([&]() {
+        map.clear();
+        mapz.clear();
+        for (int i=0; i<model->nfaces(); i++) {
+            Vec4f pts[3];
+            for (int j=0; j<3; j++) pts[j] = naive.vertex(i, j);
+            triangle(pts, (IShader &)naive, map, mapz);
+        }
+    });
+
+    TGAImage image(width, height, TGAImage::RGB);
+    DepthBuffer zbuffer(width, height);
+    Shader shader;
+    shader.uniform_model     = model;
+    shader.uniform_verts     = verts.data();
+    shader.uniform_light_dir = light_dir;
+    shader.uniform_M         = ctx.projection*ctx.view;
+    shader.uniform_MIT       = (ctx.projection*ctx.view).invert_transpose();
+    double shaded = measure([&]() { frame(shader, image, zbuffer); });
+    shader.uniform_shadow       = &shadow;
+    shader.uniform_shadow_verts = shadow_verts.data();
+    double shadowed = measure([&]() { frame(shader, image, zbuffer); });
+
+    printf("%dx%d shadow map, depth-only pass   %10.3f ms\n", size, size, depth*1e-6);
+    printf("%dx%d shadow map, IShader pass      %10.3f ms   %.2fx the depth-only pass\n", size, size, colored*1e-6, colored/depth);
+    printf("%dx%d Shader frame                  %10.3f ms   depth-only pass %.0f%% of it\n", width, height, shaded*1e-6, 100*depth/shaded);
+    printf("%dx%d Shader frame with shadows     %10.3f ms   +%.0f%% with the depth-only pass\n", width, height, shadowed*1e-6, 100*(shadowed+depth-shaded)/shaded);
+}
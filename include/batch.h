@@ -0,0 +1,31 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <string>
+#include <vector>
+#include "geometry.h"
+#include "threadpool.h"
+#include "framewriter.h"
+
+struct BatchJob {
+    std::string model;
+    Vec3f eye, center, up;
+    Vec3f light;
+    std::string shader; // gouraud, cel or normalmap
+    int width, height;
+    float lod;          // error allowed for the level of detail in pixels, 0 draws the model itself
+    int shadow;         // size of the shadow map in texels, 0 for no shadows; the normalmap shader only
+    FramePattern output; // tga file, may hold a %d or %0Nd for the job index
+    BatchJob();
+};
+
+// One job per line, whitespace separated key=value pairs:
+//   model=obj/african_head.obj eye=1,1,3 center=0,0,0 up=0,1,0 light=1,1,1 shader=gouraud size=800x800 lod=0 shadow=0 out=frame%04d.tga
+// Keys left out keep their value from the previous line, so a turntable only lists the eyes. # starts a comment.
+bool read_manifest(const char *filename, std::vector<BatchJob> &jobs);
+
+// Loads every distinct model once, then renders the jobs concurrently on the pool, one job per task.
+// Prints the aggregate frames per second to stderr, returns the number of failed jobs.
+int run_batch(const std::vector<BatchJob> &jobs, ThreadPool &pool);
+
+#endif //__BATCH_H__
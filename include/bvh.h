@@ -0,0 +1,59 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <vector>
+#include <cstdint>
+#include "geometry.h"
+#include "threadpool.h"
+
+class Model;
+
+// Bounding volume hierarchy over the triangles of a Model, in object space. Built top-down with the surface
+// area heuristic over binned centroids; the top of the tree is split serially, the subtrees below are built
+// concurrently on the pool. Nodes are stored depth first with the two children of a node next to each other,
+// and every node covers a contiguous range of faces(), so a subtree is a range of faces as well. The
+// triangles are copied in that order, queries never go back to the model.
+class BVH {
+public:
+    struct Node {
+        float bmin[3];
+        float bmax[3];
+        int start; // faces()[start, start+count) are under this node
+        int count;
+        int child; // the children are child and child+1, 0 for a leaf
+    };
+    struct Hit {
+        int face;
+        float t;   // the hit point is orig + dir*t
+        Vec3f bar; // barycentric coordinates in the face, in the order of its vertices
+    };
+
+    BVH();
+    void build(Model &model, ThreadPool &pool);
+    bool empty() const { return nodes_.empty(); }
+    int nnodes() const { return (int)nodes_.size(); }
+    const Node &node(int i) const { return nodes_[i]; }
+    const std::vector<int> &faces() const { return faces_; }
+
+    // binary cache, tied to the geometry of the model it was built for: load() fails if the model changed
+    // or if the file holds a node or a face out of range
+    bool save(const char *filename, Model &model) const;
+    bool load(const char *filename, Model &model);
+
+    // Appends the faces of the subtrees that may be visible through m (typically Viewport*Projection*ModelView)
+    // in an image of the given size, that is in front of the near plane (see NEAR_W) and inside the image.
+    // The faces come out in the order of the model, the draw order stays the one of the whole model (the
+    // leaf order is slower to draw). Whatever is left is culled triangle by triangle by the raster.
+    void cull(const Matrix &m, Vec2i imagesize, std::vector<int> &out) const;
+
+    // nearest triangle hit by the ray with t in (tmin, tmax), both sides of the triangles count
+    bool intersect(Vec3f orig, Vec3f dir, Hit &hit, float tmin=0.f, float tmax=1e30f) const;
+    // the face seen at screen position pixel through the perspective transform m, t is the w of the hit
+    bool pick(const Matrix &m, Vec2f pixel, Hit &hit) const;
+private:
+    std::vector<Node> nodes_;
+    std::vector<int> faces_;
+    std::vector<Vec3f> tris_; // three vertices per entry of faces_
+};
+
+#endif //__BVH_H__
@@ -0,0 +1,52 @@
+#ifndef __DEPTHBUFFER_H__
+#define __DEPTHBUFFER_H__
+
+#include <vector>
+#include "tgaimage.h"
+
+// 32-bit float z-buffer. With reversed-Z (the default) bigger values are closer to the camera,
+// otherwise smaller values are. On top of the pixels it keeps the nearest and the farthest depth of
+// every BLOCK_SIZE x BLOCK_SIZE block, so the rasterizer can reject whole blocks at once.
+class DepthBuffer {
+public:
+    static const int BLOCK_SIZE = 8;
+
+    DepthBuffer(int w, int h, bool reversed=true);
+    int get_width()  const { return width_;    }
+    int get_height() const { return height_;   }
+    bool reversed()  const { return reversed_; }
+    void clear();
+
+    bool closer(float a, float b) const { return reversed_ ? a>b : a<b; }
+    float farthest() const; // the value the buffer is cleared with
+
+    // unchecked access, whoever writes through row() must call touch() for the written blocks
+    float *row(int y) { return &data_[y*width_]; }
+    const float *row(int y) const { return &data_[y*width_]; }
+    float get(int x, int y) const { return data_[x+y*width_]; }
+    void set(int x, int y, float z) { data_[x+y*width_] = z; touch(x/BLOCK_SIZE, y/BLOCK_SIZE); }
+
+    // hierarchical layer, (bx, by) are block coordinates
+    void touch(int bx, int by) { dirty_[bx+by*nblocks_x_] = 1; }
+    float block_near(int bx, int by);
+    float block_far (int bx, int by);
+
+    // grayscale debug image, depth range [znear, zfar] is mapped to 255..0
+    TGAImage to_image(float znear, float zfar) const;
+    TGAImage to_image() const; // [0,1] range as given by viewport()
+private:
+    void update_block(int b);
+
+    int width_;
+    int height_;
+    bool reversed_;
+    int nblocks_x_;
+    int nblocks_y_;
+    std::vector<float> data_;
+    std::vector<float> near_;
+    std::vector<float> far_;
+    std::vector<unsigned char> dirty_;
+};
+
+#endif //__DEPTHBUFFER_H__
+
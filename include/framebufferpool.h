@@ -0,0 +1,39 @@
+#ifndef __FRAMEBUFFERPOOL_H__
+#define __FRAMEBUFFERPOOL_H__
+
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <unordered_map>
+
+// Recycles pixel buffers across frames and renders: a released buffer is kept (still mapped and warm)
+// and handed out again to the next request it is big enough for. Every buffer is FRAMEBUFFER_ALIGNMENT
+// aligned. Thread-safe. The pool must outlive the buffers (and the images) it gave out.
+const size_t FRAMEBUFFER_ALIGNMENT = 64;
+
+class FramebufferPool {
+public:
+    FramebufferPool();
+    ~FramebufferPool();
+    FramebufferPool(const FramebufferPool &) = delete;
+    FramebufferPool & operator =(const FramebufferPool &) = delete;
+
+    unsigned char *acquire(size_t nbytes); // uninitialized, the smallest free buffer that fits or a new one
+    void release(unsigned char *p);
+    void trim(); // frees the buffers nobody holds
+    size_t cached_bytes();
+    static FramebufferPool &shared(); // process-wide pool, created on first use
+private:
+    struct Buffer {
+        unsigned char *data;
+        size_t capacity;
+    };
+    std::mutex mutex_;
+    std::vector<Buffer> free_;
+    std::unordered_map<unsigned char *, size_t> used_; // capacity of the buffers given out
+};
+
+unsigned char *aligned_pixels(size_t nbytes); // FRAMEBUFFER_ALIGNMENT aligned, not pooled
+void free_aligned_pixels(unsigned char *p);
+
+#endif //__FRAMEBUFFERPOOL_H__
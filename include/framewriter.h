@@ -0,0 +1,83 @@
+#ifndef __FRAMEWRITER_H__
+#define __FRAMEWRITER_H__
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <condition_variable>
+#include "tgaimage.h"
+
+// File name of numbered frames: text with at most one conversion, %d or %0Nd, that gets the frame number ("%%"
+// is a literal %). Parsed once and never handed to printf as a format, anything else is rejected.
+class FramePattern {
+public:
+    FramePattern(); // the empty name, not numbered
+    bool parse(const std::string &pattern); // false if the pattern holds any other conversion, or two
+    bool numbered() const { return numbered_; } // false when every frame gets the same name
+    std::string name(int index) const;
+private:
+    std::string prefix_;
+    std::string suffix_;
+    int width_; // zero padding of the number
+    bool numbered_;
+};
+
+// Writes a sequence of frames from a background thread. Double buffered: the renderer draws into frame()
+// while the previous frame is being encoded, present() swaps the two buffers and only blocks if the encoder
+// is still busy. Frames are taken bottom-up as the renderer draws them, the vertical flip happens in the
+// write itself. Targets:
+//   TGA  numbered files, target is a FramePattern such as "frame%04d.tga"; a target without the number
+//        only takes a single frame
+//   RAW  tightly packed pixels as stored (bgr24, gray or bgra), e.g. ffmpeg -f rawvideo -pix_fmt bgr24
+//   PPM  concatenated P6 (P5 for grayscale) images
+//   Y4M  YUV4MPEG2 stream, 4:4:4 (mono for grayscale), BT.601 studio range
+// The stream formats go to a file or a FIFO, or to stdout when the target is "-".
+class FrameWriter {
+public:
+    enum Format {
+        TGA, RAW, PPM, Y4M
+    };
+
+    FrameWriter(const char *target, Format format, int width, int height, int bpp=TGAImage::RGB, int fps=25);
+    ~FrameWriter();
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter & operator =(const FrameWriter &) = delete;
+    bool is_open() const { return open_; }
+    int nframes() const { return nframes_; }
+    bool numbered() const { return names_.numbered(); } // TGA: the target has a frame number
+
+    TGAImage &frame() { return buffers_[back_]; } // cleared, width x height x bpp
+    bool present(); // false once a write has failed
+    bool close();   // waits for the pending frame, false if any write failed
+
+    static Format format_from_target(const char *target); // from the extension, Y4M for stdout, TGA otherwise
+private:
+    void encoder();
+    bool write_frame(TGAImage &img, int index);
+    bool write_stream(TGAImage &img);
+
+    std::string target_;
+    FramePattern names_;
+    Format format_;
+    int width_;
+    int height_;
+    int bpp_;
+    int fps_;
+    FILE *out_;
+    bool open_;
+    TGAImage buffers_[2];
+    int back_;
+    int nframes_;
+    std::vector<unsigned char> scratch_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool pending_;
+    bool quit_;
+    bool failed_;
+};
+
+#endif //__FRAMEWRITER_H__
@@ -0,0 +1,74 @@
+#ifndef __GBUFFER_H__
+#define __GBUFFER_H__
+
+#include <vector>
+#include <algorithm>
+#include "tgaimage.h"
+#include "geometry.h"
+#include "threadpool.h"
+#include "depthbuffer.h"
+#include "raster.h"
+
+// Visibility buffer of the deferred mode. The geometry pass keeps, for every pixel, the face that won the
+// depth test and the screen-space barycentric coordinates of the pixel in it (not perspective-corrected,
+// the same ones the forward path hands to fragment()). That is all the shading pass needs: the uv, the
+// normal and every other varying are rebuilt by the shader from the face, and the depth lives in the
+// DepthBuffer drawn along.
+class GBuffer {
+public:
+    struct Sample {
+        int face; // -1 for the background
+        Vec3f bar;
+    };
+
+    GBuffer(int w, int h);
+    int get_width()  const { return width_;  }
+    int get_height() const { return height_; }
+    void clear();
+
+    Sample *row(int y) { return &data_[y*width_]; }
+    const Sample *row(int y) const { return &data_[y*width_]; }
+    const Sample &get(int x, int y) const { return data_[x+y*width_]; }
+    void set(int x, int y, int face, const Vec3f &bar) { data_[x+y*width_] = Sample{face, bar}; }
+private:
+    int width_;
+    int height_;
+    std::vector<Sample> data_;
+};
+
+// geometry pass, no shading at all: pts are the screen coordinates of face iface, only the pixels in
+// [clipmin, clipmax) are touched
+void gbuffer_triangle(const Vec4f *pts, int iface, GBuffer &gbuffer, DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax);
+void gbuffer_triangle(const Vec4f *pts, int iface, GBuffer &gbuffer, DepthBuffer &zbuffer);
+
+const int GBUFFER_BAND = 16; // rows per task of the shading pass
+
+// Shading pass: fragment() runs exactly once per covered pixel, whatever the overdraw of the geometry pass
+// was. The rows are split into bands shaded concurrently, every band works on its own copy of the shader
+// and calls vertex() again only when the face changes along the scan. The varyings of the shader must be a
+// function of the face, and a fragment may not discard: the pixel it hides is lost by then, shaders that
+// discard need the forward path. S is a concrete shader type, it gets copied.
+template <typename S> void resolve_gbuffer(const S &shader, const GBuffer &gbuffer, TGAImage &image, ThreadPool &pool) {
+    int height = std::min(gbuffer.get_height(), image.get_height());
+    int width  = std::min(gbuffer.get_width(),  image.get_width());
+    pool.parallel_for((height+GBUFFER_BAND-1)/GBUFFER_BAND, [&](int band) {
+        S local = shader;
+        int face = -1;
+        TGAColor color;
+        for (int y=band*GBUFFER_BAND; y<std::min(height, (band+1)*GBUFFER_BAND); y++) {
+            const GBuffer::Sample *samples = gbuffer.row(y);
+            for (int x=0; x<width; x++) {
+                const GBuffer::Sample &s = samples[x];
+                if (s.face<0) continue;
+                if (s.face!=face) {
+                    face = s.face;
+                    for (int j=0; j<3; j++) local.vertex(face, j);
+                }
+                local.S::fragment(s.bar, color);
+                image.set(x, y, color);
+            }
+        }
+    });
+}
+
+#endif //__GBUFFER_H__
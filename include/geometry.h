@@ -4,6 +4,9 @@
 #include <vector>
 #include <cassert>
 #include <iostream>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 template<size_t DimCols,size_t DimRows,typename T> class mat;
 
@@ -43,6 +46,30 @@ template <typename T> struct vec<3,T> {
 
 /////////////////////////////////////////////////////////////////////////////////
 
+// the homogeneous points and the rows of Matrix, one SSE register each
+template <> struct alignas(16) vec<4,float> {
+#if defined(__SSE2__)
+    vec() : simd_(_mm_setzero_ps()) {}
+    vec(float X, float Y, float Z, float W) : simd_(_mm_setr_ps(X, Y, Z, W)) {}
+    explicit vec(__m128 v) : simd_(v) {}
+    __m128 simd() const { return simd_; }
+#else
+    vec() : data_{0.f, 0.f, 0.f, 0.f} {}
+    vec(float X, float Y, float Z, float W) : data_{X, Y, Z, W} {}
+#endif
+          float& operator[](const size_t i)       { assert(i<4); return data_[i]; }
+    const float& operator[](const size_t i) const { assert(i<4); return data_[i]; }
+private:
+    union {
+        float data_[4];
+#if defined(__SSE2__)
+        __m128 simd_;
+#endif
+    };
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
 template<size_t DIM,typename T> T operator*(const vec<DIM,T>& lhs, const vec<DIM,T>& rhs) {
     T ret = T();
     for (size_t i=DIM; i--; ret+=lhs[i]*rhs[i]);
@@ -82,10 +109,47 @@ template<size_t LEN,size_t DIM, typename T> vec<LEN,T> proj(const vec<DIM,T> &v)
     return ret;
 }
 
+// the homogeneous coordinates of the points, built in a register rather than element by element
+template<> inline vec<4,float> embed<4,3,float>(const vec<3,float> &v, float fill) {
+    return vec<4,float>(v.x, v.y, v.z, fill);
+}
+
+template<> inline vec<3,float> proj<3,4,float>(const vec<4,float> &v) {
+    return vec<3,float>(v[0], v[1], v[2]);
+}
+
 template <typename T> vec<3,T> cross(vec<3,T> v1, vec<3,T> v2) {
     return vec<3,T>(v1.y*v2.z - v1.z*v2.y, v1.z*v2.x - v1.x*v2.z, v1.x*v2.y - v1.y*v2.x);
 }
 
+// Vec4f overloads of the above, the sums are done in the same order so that the results do not change
+inline float operator*(const vec<4,float>& lhs, const vec<4,float>& rhs) {
+#if defined(__SSE2__)
+    vec<4,float> p(_mm_mul_ps(lhs.simd(), rhs.simd()));
+    return 0.f + p[3] + p[2] + p[1] + p[0];
+#else
+    return 0.f + lhs[3]*rhs[3] + lhs[2]*rhs[2] + lhs[1]*rhs[1] + lhs[0]*rhs[0];
+#endif
+}
+
+#if defined(__SSE2__)
+inline vec<4,float> operator+(const vec<4,float>& lhs, const vec<4,float>& rhs) {
+    return vec<4,float>(_mm_add_ps(lhs.simd(), rhs.simd()));
+}
+
+inline vec<4,float> operator-(const vec<4,float>& lhs, const vec<4,float>& rhs) {
+    return vec<4,float>(_mm_sub_ps(lhs.simd(), rhs.simd()));
+}
+
+inline vec<4,float> operator*(const vec<4,float>& lhs, float rhs) {
+    return vec<4,float>(_mm_mul_ps(lhs.simd(), _mm_set1_ps(rhs)));
+}
+
+inline vec<4,float> operator/(const vec<4,float>& lhs, float rhs) {
+    return vec<4,float>(_mm_div_ps(lhs.simd(), _mm_set1_ps(rhs)));
+}
+#endif
+
 template <size_t DIM, typename T> std::ostream& operator<<(std::ostream& out, vec<DIM,T>& v) {
     for(unsigned int i=0; i<DIM; i++) {
         out << v[i] << " " ;
@@ -201,11 +265,156 @@ template <size_t DimRows,size_t DimCols,class T> std::ostream& operator<<(std::o
 
 /////////////////////////////////////////////////////////////////////////////////
 
+// the transforms, with closed forms instead of the recursion through the minors
+template<> class mat<4,4,float> {
+    vec<4,float> rows[4];
+public:
+    mat() {}
+
+    vec<4,float>& operator[] (const size_t idx) {
+        assert(idx<4);
+        return rows[idx];
+    }
+
+    const vec<4,float>& operator[] (const size_t idx) const {
+        assert(idx<4);
+        return rows[idx];
+    }
+
+    vec<4,float> col(const size_t idx) const {
+        assert(idx<4);
+        return vec<4,float>(rows[0][idx], rows[1][idx], rows[2][idx], rows[3][idx]);
+    }
+
+    void set_col(size_t idx, vec<4,float> v) {
+        assert(idx<4);
+        for (size_t i=4; i--; rows[i][idx]=v[i]);
+    }
+
+    static mat<4,4,float> identity() {
+        mat<4,4,float> ret;
+        for (size_t i=4; i--; ret[i][i]=1.f);
+        return ret;
+    }
+
+    mat<4,4,float> transpose() const {
+        mat<4,4,float> ret;
+#if defined(__SSE2__)
+        __m128 r0 = rows[0].simd(), r1 = rows[1].simd(), r2 = rows[2].simd(), r3 = rows[3].simd();
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        ret[0] = vec<4,float>(r0); ret[1] = vec<4,float>(r1); ret[2] = vec<4,float>(r2); ret[3] = vec<4,float>(r3);
+#else
+        for (size_t i=4; i--; ret[i]=col(i));
+#endif
+        return ret;
+    }
+
+    float det() const {
+        float s[6], c[6];
+        minors(s, c);
+        return s[0]*c[5] - s[1]*c[4] + s[2]*c[3] + s[3]*c[2] - s[4]*c[1] + s[5]*c[0];
+    }
+
+    mat<3,3,float> get_minor(size_t row, size_t col) const {
+        mat<3,3,float> ret;
+        for (size_t i=3; i--; )
+            for (size_t j=3; j--; ret[i][j]=rows[i<row?i:i+1][j<col?j:j+1]);
+        return ret;
+    }
+
+    float cofactor(size_t row, size_t col) const {
+        return get_minor(row,col).det()*((row+col)%2 ? -1 : 1);
+    }
+
+    // the matrix of the cofactors, as the generic one
+    mat<4,4,float> adjugate() const {
+        float s[6], c[6];
+        minors(s, c);
+        return cofactors(s, c);
+    }
+
+    mat<4,4,float> invert_transpose() const {
+        float s[6], c[6];
+        minors(s, c);
+        mat<4,4,float> ret = cofactors(s, c);
+        return ret/(s[0]*c[5] - s[1]*c[4] + s[2]*c[3] + s[3]*c[2] - s[4]*c[1] + s[5]*c[0]);
+    }
+
+    mat<4,4,float> invert() const {
+        return invert_transpose().transpose();
+    }
+
+private:
+    // the 2x2 determinants of the two upper rows (s) and of the two lower ones (c) every cofactor is made of
+    void minors(float s[6], float c[6]) const {
+        const vec<4,float> &a = rows[0], &b = rows[1], &e = rows[2], &f = rows[3];
+        s[0] = a[0]*b[1] - b[0]*a[1]; c[0] = e[0]*f[1] - f[0]*e[1];
+        s[1] = a[0]*b[2] - b[0]*a[2]; c[1] = e[0]*f[2] - f[0]*e[2];
+        s[2] = a[0]*b[3] - b[0]*a[3]; c[2] = e[0]*f[3] - f[0]*e[3];
+        s[3] = a[1]*b[2] - b[1]*a[2]; c[3] = e[1]*f[2] - f[1]*e[2];
+        s[4] = a[1]*b[3] - b[1]*a[3]; c[4] = e[1]*f[3] - f[1]*e[3];
+        s[5] = a[2]*b[3] - b[2]*a[3]; c[5] = e[2]*f[3] - f[2]*e[3];
+    }
+
+    mat<4,4,float> cofactors(const float s[6], const float c[6]) const {
+        const vec<4,float> &a = rows[0], &b = rows[1], &e = rows[2], &f = rows[3];
+        mat<4,4,float> ret;
+        ret[0] = vec<4,float>( b[1]*c[5] - b[2]*c[4] + b[3]*c[3], -b[0]*c[5] + b[2]*c[2] - b[3]*c[1],  b[0]*c[4] - b[1]*c[2] + b[3]*c[0], -b[0]*c[3] + b[1]*c[1] - b[2]*c[0]);
+        ret[1] = vec<4,float>(-a[1]*c[5] + a[2]*c[4] - a[3]*c[3],  a[0]*c[5] - a[2]*c[2] + a[3]*c[1], -a[0]*c[4] + a[1]*c[2] - a[3]*c[0],  a[0]*c[3] - a[1]*c[1] + a[2]*c[0]);
+        ret[2] = vec<4,float>( f[1]*s[5] - f[2]*s[4] + f[3]*s[3], -f[0]*s[5] + f[2]*s[2] - f[3]*s[1],  f[0]*s[4] - f[1]*s[2] + f[3]*s[0], -f[0]*s[3] + f[1]*s[1] - f[2]*s[0]);
+        ret[3] = vec<4,float>(-e[1]*s[5] + e[2]*s[4] - e[3]*s[3],  e[0]*s[5] - e[2]*s[2] + e[3]*s[1], -e[0]*s[4] + e[1]*s[2] - e[3]*s[0],  e[0]*s[3] - e[1]*s[1] + e[2]*s[0]);
+        return ret;
+    }
+
+    friend mat<4,4,float> operator/(mat<4,4,float> lhs, float rhs) {
+        for (size_t i=4; i--; lhs[i]=lhs[i]/rhs);
+        return lhs;
+    }
+};
+
+// Matrix overloads of the generic products, summed in the same order
+inline vec<4,float> operator*(const mat<4,4,float>& lhs, const vec<4,float>& rhs) {
+#if defined(__SSE2__)
+    __m128 v = rhs.simd();
+    __m128 p0 = _mm_mul_ps(lhs[0].simd(), v), p1 = _mm_mul_ps(lhs[1].simd(), v);
+    __m128 p2 = _mm_mul_ps(lhs[2].simd(), v), p3 = _mm_mul_ps(lhs[3].simd(), v);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3); // p<k> holds the k-th term of every row
+    return vec<4,float>(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_setzero_ps(), p3), p2), p1), p0));
+#else
+    vec<4,float> ret;
+    for (size_t i=4; i--; ret[i]=lhs[i]*rhs);
+    return ret;
+#endif
+}
+
+inline mat<4,4,float> operator*(const mat<4,4,float>& lhs, const mat<4,4,float>& rhs) {
+    mat<4,4,float> result;
+#if defined(__SSE2__)
+    for (size_t i=4; i--; ) {
+        __m128 sum = _mm_setzero_ps();
+        for (size_t k=4; k--; sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(lhs[i][k]), rhs[k].simd())));
+        result[i] = vec<4,float>(sum);
+    }
+#else
+    for (size_t i=4; i--; )
+        for (size_t j=4; j--; result[i][j]=lhs[i]*rhs.col(j));
+#endif
+    return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
 typedef vec<2,  float> Vec2f;
 typedef vec<2,  int>   Vec2i;
 typedef vec<3,  float> Vec3f;
 typedef vec<3,  int>   Vec3i;
 typedef vec<4,  float> Vec4f;
 typedef mat<4,4,float> Matrix;
+
+// batched transforms by m of n entries given as structures of arrays: the points (x[i], y[i], z[i], 1) into
+// out[i], and the directions (x[i], y[i], z[i], 0) into (ox[i], oy[i], oz[i]), normals need the inverse
+// transpose of the transform of the points
+void transform_points(const Matrix &m, const float *x, const float *y, const float *z, int n, Vec4f *out);
+void transform_directions(const Matrix &m, const float *x, const float *y, const float *z, int n, float *ox, float *oy, float *oz);
 #endif //__GEOMETRY_H__
 
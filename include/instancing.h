@@ -0,0 +1,76 @@
+#ifndef __INSTANCING_H__
+#define __INSTANCING_H__
+
+#include <vector>
+#include <memory>
+#include "model.h"
+#include "our_gl.h"
+#include "stats.h"
+
+// true when the box [bmin, bmax] is entirely out of the image or behind the near plane through m (object
+// to screen, before the division by w): all its corners are on the outer side of one of the planes
+inline bool box_outside(const Matrix &m, Vec3f bmin, Vec3f bmax, Vec2i imagesize) {
+    Vec4f planes[5] = {m[0]+m[3]*SNAP_SLACK, m[3]*(imagesize.x+SNAP_SLACK)-m[0], m[1]+m[3]*SNAP_SLACK, m[3]*(imagesize.y+SNAP_SLACK)-m[1], m[3]};
+    planes[4][3] -= NEAR_W;
+    for (int i=0; i<5; i++) {
+        bool out = true;
+        for (int c=0; out && c<8; c++) {
+            Vec3f corner(c&1 ? bmax.x : bmin.x, c&2 ? bmax.y : bmin.y, c&4 ? bmax.z : bmin.z);
+            out = planes[i]*embed<4>(corner)<0;
+        }
+        if (out) return true;
+    }
+    return false;
+}
+
+// Instanced draw: the model once per entry of transforms (object to world), through the camera of ctx. The
+// model itself, its arrays and its normals normalized at load, is shared; what is left per instance is the
+// vertex transform into a buffer of its own and the uniforms, that setup(i, shader, verts) sets in a copy
+// of shader for instance i (verts: its vertices on the screen, as from transform_vertices()). Lighting can
+// stay in object space, see object_direction(). The instances whose bounding box is out of the view are
+// skipped, and with lod_error>0 every instance draws the level of detail select_lod() picks for it. With a
+// pool the vertices are transformed concurrently and the faces go through a TiledRaster, S is copied per
+// triangle then. The result is the one of drawing the instances one after the other.
+template <typename S, typename F> void draw_instanced(Model &model, const DrawContext &ctx, const std::vector<Matrix> &transforms, const S &shader, F setup, TGAImage &image, DepthBuffer &zbuffer, ThreadPool *pool=NULL, float lod_error=0) {
+    Vec2i size(image.get_width(), image.get_height());
+    Matrix clip = ctx.clip();
+    std::vector<Matrix> m;
+    std::vector<int> visible, level;
+    for (int i=0; i<(int)transforms.size(); i++) {
+        Matrix mi = clip*transforms[i];
+        if (box_outside(mi, model.bbox_min(), model.bbox_max(), size)) continue;
+        m.push_back(mi);
+        visible.push_back(i);
+        level.push_back(lod_error>0 ? model.select_lod(mi, lod_error) : 0);
+    }
+    int n = (int)visible.size();
+    std::vector<std::vector<Vec4f> > verts(pool ? n : 1); // the serial path needs only one at a time
+    if (pool) {
+        STATS_TIMER(STAGE_VERTEX);
+        pool->parallel_for(n, [&](int k) { transform_vertices(model, m[k], verts[k]); });
+    }
+    std::unique_ptr<TiledRaster<S> > raster(pool ? new TiledRaster<S>(image, zbuffer) : NULL);
+    for (int k=0; k<n; k++) {
+        std::vector<Vec4f> &v = verts[pool ? k : 0];
+        if (!pool) {
+            STATS_TIMER(STAGE_VERTEX);
+            transform_vertices(model, m[k], v);
+        }
+        S local = shader;
+        setup(visible[k], local, v.data());
+        STATS_TIMER(STAGE_RASTER);
+        int first = model.lod_first_face(level[k]), last = first+model.lod_nfaces(level[k]);
+        for (int i=first; i<last; i++) {
+            Vec4f screen_coords[3];
+            for (int j=0; j<3; j++) screen_coords[j] = local.S::vertex(i, j);
+            if (raster) raster->add(screen_coords, local);
+            else triangle(screen_coords, local, image, zbuffer);
+        }
+    }
+    if (raster) {
+        STATS_TIMER(STAGE_RASTER);
+        raster->flush(*pool);
+    }
+}
+
+#endif //__INSTANCING_H__
@@ -0,0 +1,25 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <cstddef>
+
+// read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator =(const MappedFile &) = delete;
+    bool open(const char *filename);
+    void close();
+    bool is_open() const { return open_; }
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+private:
+    const char *data_;
+    size_t size_;
+    bool open_;
+};
+
+#endif //__MAPPEDFILE_H__
+
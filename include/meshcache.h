@@ -0,0 +1,40 @@
+#ifndef __MESHCACHE_H__
+#define __MESHCACHE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include "mappedfile.h"
+
+// Flat structure-of-arrays mesh: one float array per coordinate and one index array per attribute,
+// three indices per triangle. All the arrays live in a single block, every one of them aligned on
+// MESH_ALIGNMENT bytes. The binary cache is a header followed by that very block, so the arrays can be
+// used straight from a mapping of the file.
+const uint32_t MESH_CACHE_VERSION = 4;
+const size_t MESH_ALIGNMENT = 32;
+
+// MESH_FACES are the faces of the model, the simplified levels of detail (MESH_LODS of them, the model
+// itself included) add MESH_LOD_FACES more faces after them in the index arrays
+enum MeshCount { MESH_VERTS, MESH_NORMS, MESH_UVS, MESH_FACES, MESH_LOD_FACES, MESH_LODS, MESH_NCOUNTS };
+
+struct MeshArrays {
+    int count[MESH_NCOUNTS];
+    const float *vert[3]; // x, y, z of the vertices
+    const float *norm[3];
+    const float *uv[2];
+    const int *vert_idx;  // three per triangle
+    const int *uv_idx;
+    const int *norm_idx;
+    const int *lod_range; // first face and number of faces of every level
+    const float *lod_error;
+};
+
+size_t mesh_block_size(const int count[MESH_NCOUNTS]);
+void bind_mesh_block(const char *block, const int count[MESH_NCOUNTS], MeshArrays &mesh); // block must be MESH_ALIGNMENT aligned
+
+uint64_t hash_bytes(const char *data, size_t size);
+bool write_mesh_cache(const char *filename, uint64_t hash, const char *block, const int count[MESH_NCOUNTS]);
+// mesh points into the mapping; false when the file does not match hash or holds an index out of range
+bool read_mesh_cache(const MappedFile &file, uint64_t hash, MeshArrays &mesh);
+
+#endif //__MESHCACHE_H__
+
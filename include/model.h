@@ -1,33 +1,82 @@
 #ifndef __MODEL_H__
 #define __MODEL_H__
+#include <new>
 #include <vector>
 #include <string>
+#include <memory>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "texture.h"
+#include "span.h"
+#include "mappedfile.h"
+#include "meshcache.h"
 
+// Faces are triangulated at load. The mesh arrays (see MeshArrays) either live in block_ or, when the
+// binary cache <filename>.mesh is up to date, are read straight from its memory mapping. A model loaded with
+// reorder has its faces and vertices reordered for locality (see reorder.h), the draw order changes, and
+// is cached as <filename>.reordered.mesh.
 class Model {
 private:
-    std::vector<Vec3f> verts_;
-    std::vector<std::vector<Vec3i> > faces_; // attention, this Vec3i means vertex/uv/normal
-    std::vector<Vec3f> norms_;
-    std::vector<Vec2f> uv_;
-    TGAImage diffusemap_;
-    TGAImage normalmap_;
-    TGAImage specularmap_;
-    void load_texture(std::string filename, const char *suffix, TGAImage &img);
+    struct AlignedDelete {
+        void operator()(char *p) const { ::operator delete[](p, std::align_val_t(MESH_ALIGNMENT)); }
+    };
+    MeshArrays mesh_;
+    std::unique_ptr<char[], AlignedDelete> block_;
+    MappedFile cache_;
+    Texture diffusemap_;
+    Texture normalmap_;
+    Texture specularmap_;
+    Texture::Filter filter_;
+    Vec3f bbox_min_;
+    Vec3f bbox_max_;
+    void load_obj(const MappedFile &obj, bool reorder);
+    void load_texture(std::string filename, const char *suffix, Texture &tex);
 public:
-    Model(const char *filename);
+    Model(const char *filename, bool reorder=false);
     ~Model();
+    Model(const Model &) = delete;
+    Model & operator =(const Model &) = delete;
     int nverts();
     int nfaces();
+    int nnormals();
     Vec3f normal(int iface, int nthvert);
     Vec3f normal(Vec2f uv);
+    Vec3f normal(int i);
     Vec3f vert(int i);
     Vec3f vert(int iface, int nthvert);
+    int vert_index(int iface, int nthvert);
+    int normal_index(int iface, int nthvert);
     Vec2f uv(int iface, int nthvert);
     TGAColor diffuse(Vec2f uv);
     float specular(Vec2f uv);
-    std::vector<int> face(int idx);
+    // filtered lookups, the mip level comes from the uv derivatives along the screen axes
+    void set_filter(Texture::Filter filter);
+    TGAColor diffuse(Vec2f uv, Vec2f duvdx, Vec2f duvdy);
+    Vec3f normal(Vec2f uv, Vec2f duvdx, Vec2f duvdy);
+    float specular(Vec2f uv, Vec2f duvdx, Vec2f duvdy);
+    Span<const int> face(int idx); // vertex indices of the face
+
+    // Levels of detail built at load, see build_lod_chain(). Level 0 is the model, faces [0, nfaces()), the
+    // faces of level i are [lod_first_face(i), lod_first_face(i)+lod_nfaces(i)) and can be drawn like any
+    // other face: they use the same vertices, uvs and normals.
+    int nlods();
+    int lod_first_face(int level);
+    int lod_nfaces(int level);
+    float lod_error(int level); // object space
+    // the coarsest level whose error stays under max_error pixels on the screen through m (typically
+    // Viewport*Projection*ModelView), measured where the bounding box of the model is the closest to the eye
+    int select_lod(const Matrix &m, float max_error=1.f);
+    // bounding box of the vertices, object space
+    Vec3f bbox_min() { return bbox_min_; }
+    Vec3f bbox_max() { return bbox_max_; }
+
+    // the flat arrays themselves, coord is 0,1,2 for x,y,z (0,1 for u,v)
+    Span<const float> verts(int coord);
+    Span<const float> normals(int coord);
+    Span<const float> uvs(int coord);
+    Span<const int> vert_indices();   // three per face
+    Span<const int> uv_indices();
+    Span<const int> normal_indices();
 };
 #endif //__MODEL_H__
 
@@ -0,0 +1,194 @@
+#ifndef __MSAA_H__
+#define __MSAA_H__
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include "tgaimage.h"
+#include "geometry.h"
+#include "threadpool.h"
+#include "depthbuffer.h"
+#include "raster.h"
+#include "stats.h"
+
+// Multisampled color and depth target: every pixel has samples() depth and color values, at the standard
+// rotated positions of 2x, 4x or 8x MSAA. The depth of each sample is a plane of its own, a DepthBuffer with
+// its hierarchical layer; the colors of a pixel are contiguous, BGRA packed in 32 bits.
+class MultisampleBuffer {
+public:
+    static const int MAX_SAMPLES = 8;
+
+    MultisampleBuffer(int w, int h, int samples=4, bool reversed=true); // samples rounded up to 1, 2, 4 or 8
+    int get_width()  const { return width_;   }
+    int get_height() const { return height_;  }
+    int samples()    const { return samples_; }
+    void clear(); // depth to the farthest, colors to black
+
+    // position of sample k relative to the pixel, in 1/16 of a pixel
+    Vec2i offset(int k) const;
+
+    DepthBuffer &depth(int k) { return depth_[k]; }
+    const DepthBuffer &depth(int k) const { return depth_[k]; }
+    uint32_t *colors(int x, int y) { return &color_[(x+y*width_)*samples_]; }
+    const uint32_t *colors(int x, int y) const { return &color_[(x+y*width_)*samples_]; }
+
+    // color of the samples of pixel (x, y) in the bit mask
+    void store(int x, int y, int mask, const TGAColor &color) {
+        uint32_t packed;
+        memcpy(&packed, color.bgra, 4);
+        uint32_t *c = colors(x, y);
+        for (int k=0; mask; k++, mask>>=1)
+            if (mask&1) c[k] = packed;
+    }
+private:
+    int width_;
+    int height_;
+    int samples_;
+    std::vector<DepthBuffer> depth_;
+    std::vector<uint32_t> color_;
+};
+
+// Scan conversion of one triangle into a MultisampleBuffer, the counterpart of rasterize_triangle(). Coverage
+// and depth are tested per sample, but fragment(x, y, bar, mask) is called once per pixel with the samples
+// that passed in mask; it stores the color itself and returns false to discard, the depth of the samples is
+// written otherwise. bar is taken at the center of the pixel, or at the first sample that passed when the
+// center is out of the triangle, so that the varyings are never extrapolated.
+template <typename F> void rasterize_multisample(const Vec4f *pts, const Vec3f *remap, MultisampleBuffer &target, Vec2i clipmin, Vec2i clipmax, F &fragment) {
+    STATS_SCOPE();
+    const int n = target.samples();
+    TriangleSetup t;
+    if (!setup_triangle(pts, target.depth(0), clipmin, clipmax, t, .5f)) {
+        STATS_ADD(triangles_culled, t.culled);
+        return;
+    }
+    const Edge *e = t.e;
+    // the edge functions at sample k are the ones at the pixel plus these; the offsets are in 1/16 of a
+    // pixel, the fixed-point steps are multiples of 1<<SUBPIXEL_BITS, that is 16
+    float step[MultisampleBuffer::MAX_SAMPLES][3];
+    int64_t step64[MultisampleBuffer::MAX_SAMPLES][3];
+    for (int k=0; k<n; k++) {
+        Vec2i o = target.offset(k);
+        for (int i=0; i<3; i++) {
+            if (t.fixed) step64[k][i] = (t.a[i]*o.x + t.b[i]*o.y)/16;
+            else         step[k][i]   = (e[i].a*o.x + e[i].b*o.y)/16.f;
+        }
+    }
+    float bar[MultisampleBuffer::MAX_SAMPLES+1][3][BLOCK_SIZE]; // the pixel centers, then every sample
+    int mask[MultisampleBuffer::MAX_SAMPLES+1];
+    float depth[MultisampleBuffer::MAX_SAMPLES][BLOCK_SIZE];
+    for (int by=t.ymin&~(BLOCK_SIZE-1); by<=t.ymax; by+=BLOCK_SIZE) {
+        for (int bx=t.xmin&~(BLOCK_SIZE-1); bx<=t.xmax; bx+=BLOCK_SIZE) {
+            bool outside = false; // no sample of the block is on the right side of some edge
+            float row[3];
+            int64_t row64[3];
+            for (int i=0; !outside && i<3; i++) {
+                if (t.fixed) {
+                    row64[i] = t.a[i]*bx + t.b[i]*by + t.c[i];
+                    outside = row64[i] + std::max<int64_t>(0, t.a[i]*(BLOCK_SIZE-1)) + std::max<int64_t>(0, t.b[i]*(BLOCK_SIZE-1)) + (std::abs(t.a[i])+std::abs(t.b[i]))/2 < t.bias[i];
+                } else {
+                    row[i] = e[i].a*bx + e[i].b*by + e[i].c;
+                    outside = row[i] + std::max(0.f, e[i].a*(BLOCK_SIZE-1)) + std::max(0.f, e[i].b*(BLOCK_SIZE-1)) + (std::abs(e[i].a)+std::abs(e[i].b))*.5f < 0;
+                }
+            }
+            bool hidden = true;
+            for (int k=0; hidden && k<n; k++) hidden = !target.depth(k).closer(t.nearest, target.depth(k).block_far(bx/BLOCK_SIZE, by/BLOCK_SIZE));
+            if (outside || hidden) {
+                STATS_ADD(blocks_rejected, 1);
+                continue;
+            }
+            int written = 0; // the depth planes touched
+            int columns = (1<<BLOCK_SIZE)-1;
+            if (bx<t.xmin) columns &= ~((1<<(t.xmin-bx))-1);
+            if (t.xmax-bx+1<BLOCK_SIZE) columns &= (1<<(t.xmax-bx+1))-1;
+            for (int y=by; y<=std::min(t.ymax, by+BLOCK_SIZE-1); y++) {
+                int any = 0; // the pixels with some sample covered
+                if (y>=t.ymin) {
+                    for (int k=0; k<=n; k++) {
+                        if (!t.fixed) {
+                            float r[3];
+                            for (int i=0; i<3; i++) r[i] = row[i] + (k ? step[k-1][i] : 0.f);
+                            mask[k] = row_coverage(e, r, t.bias, t.inv_area, bar[k]);
+                        } else if (t.wide) {
+                            int64_t r[3];
+                            for (int i=0; i<3; i++) r[i] = row64[i] + (k ? step64[k-1][i] : 0);
+                            mask[k] = row_coverage_fixed(r, t.a, t.bias, t.inv_area, bar[k]);
+                        } else {
+                            int32_t r[3];
+                            for (int i=0; i<3; i++) r[i] = (int32_t)(row64[i] + (k ? step64[k-1][i] : 0));
+                            mask[k] = row_coverage_fixed(r, t.a32, t.bias, t.inv_area, bar[k]);
+                        }
+                        mask[k] &= columns;
+                        if (k) any |= mask[k];
+                    }
+                    STATS_ADD(pixels_tested, __builtin_popcount(columns));
+                }
+                for (int i=0; i<3; i++) {
+                    if (t.fixed) row64[i] += t.b[i];
+                    else         row[i]   += e[i].b;
+                }
+                // the depth test of every covered sample, a row of the block at a time
+                int passed[BLOCK_SIZE] = {0};
+                for (int k=0; any && k<n; k++) {
+                    if (!mask[k+1]) continue;
+                    const float (&b)[3][BLOCK_SIZE] = bar[k+1];
+                    for (int p=0; p<BLOCK_SIZE; p++) {
+                        float z = pts[0][2]*b[0][p] + pts[1][2]*b[1][p] + pts[2][2]*b[2][p];
+                        float w = pts[0][3]*b[0][p] + pts[1][3]*b[1][p] + pts[2][3]*b[2][p];
+                        depth[k][p] = z/w;
+                    }
+                    float *zrow = target.depth(k).row(y) + bx;
+                    for (int p=0, m=mask[k+1]; m; p++, m>>=1)
+                        if ((m&1) && target.depth(k).closer(depth[k][p], zrow[p])) passed[p] |= 1<<k;
+                }
+                for (int p=0; any; p++, any>>=1) {
+                    if (!(any&1)) continue;
+                    int x = bx+p;
+                    if (!passed[p]) {
+                        STATS_ADD(depth_failed, 1);
+                        continue;
+                    }
+                    int s = mask[0]>>p & 1 ? 0 : 1+__builtin_ctz(passed[p]); // else the first sample covered and visible
+                    Vec3f c(bar[s][0][p], bar[s][1][p], bar[s][2][p]);
+                    if (remap) c = remap[0]*c.x + remap[1]*c.y + remap[2]*c.z;
+                    bool kept = fragment(x, y, c, passed[p]);
+                    STATS_ADD(fragments_shaded, 1);
+                    STATS_ADD(discarded, !kept);
+                    STATS_HEAT(x, y);
+                    if (!kept) continue;
+                    written |= passed[p];
+                    for (int k=0, m=passed[p]; m; k++, m>>=1)
+                        if (m&1) target.depth(k).row(y)[x] = depth[k][p];
+                }
+            }
+            for (int k=0; written; k++, written>>=1)
+                if (written&1) target.depth(k).touch(bx/BLOCK_SIZE, by/BLOCK_SIZE);
+        }
+    }
+}
+
+// the multisampled triangle(), the shader runs at most once per pixel whatever the number of samples
+template <typename S> void multisample_triangle(Vec4f *pts, S &shader, MultisampleBuffer &target) {
+    STATS_SCOPE();
+    STATS_ADD(triangles_submitted, 1);
+    TGAColor color;
+    auto shade = [&](int x, int y, const Vec3f &bar, int samples) {
+        bool discard;
+        if constexpr (std::is_abstract<S>::value) discard = shader.fragment(bar, color);
+        else discard = shader.S::fragment(bar, color);
+        if (!discard) target.store(x, y, samples, color);
+        return !discard;
+    };
+    Vec2i size(target.get_width(), target.get_height());
+    draw_primitive(pts, size, Vec2i(0, 0), size, [&](const Vec4f *v, const Vec3f *remap) {
+        rasterize_multisample(v, remap, target, Vec2i(0, 0), size, shade);
+    });
+}
+
+const int RESOLVE_BAND = 16; // rows per task of the resolve
+
+// box filter of the samples of every pixel into image, the rows are split into bands resolved concurrently
+void resolve_multisample(const MultisampleBuffer &target, TGAImage &image, ThreadPool &pool);
+
+#endif //__MSAA_H__
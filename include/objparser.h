@@ -0,0 +1,23 @@
+#ifndef __OBJPARSER_H__
+#define __OBJPARSER_H__
+
+#include <vector>
+#include <cstddef>
+#include "geometry.h"
+#include "threadpool.h"
+
+struct ObjData {
+    std::vector<Vec3f> verts;
+    std::vector<Vec3f> norms;
+    std::vector<Vec2f> uv;
+    std::vector<Vec3i> corners; // three per triangle, vertex/uv/normal indices, -1 when the face does not give one
+};
+
+// Parses a Wavefront OBJ held in memory (typically a MappedFile). The text is split into newline-aligned
+// chunks parsed concurrently on the pool, then the per-chunk arrays are concatenated. Faces may be given
+// as v, v/vt, v//vn or v/vt/vn, negative (relative) indices are supported, polygons are split into fans.
+// Faces referencing a nonexistent vertex are dropped, nonexistent uv/normal indices become -1.
+void parse_obj(const char *data, size_t size, ObjData &out, ThreadPool &pool);
+
+#endif //__OBJPARSER_H__
+
@@ -1,24 +1,148 @@
 #ifndef __OUR_GL_H__
 #define __OUR_GL_H__
 
+#include <vector>
+#include <algorithm>
 #include "tgaimage.h"
 #include "geometry.h"
+#include "threadpool.h"
+#include "depthbuffer.h"
+#include "raster.h"
 
-extern Matrix ModelView;
-extern Matrix Viewport;
-extern Matrix Projection;
+extern thread_local Matrix ModelView; // camera of the immediate functions, per thread (see DrawContext for the per-draw one)
+extern thread_local Matrix Viewport;
+extern thread_local Matrix Projection;
 
-void viewport(int x, int y, int w, int h);
+void viewport(int x, int y, int w, int h, bool reversed_z=true); // depth goes to [0,1], 1 is the closest with reversed_z
 void projection(float coeff=0.f); // coeff = -1/c
 void lookat(Vec3f eye, Vec3f center, Vec3f up);
 
+// the matrices the three functions above put in the globals
+Matrix viewport_matrix(int x, int y, int w, int h, bool reversed_z=true);
+Matrix projection_matrix(float coeff=0.f);
+Matrix lookat_matrix(Vec3f eye, Vec3f center, Vec3f up);
+
+// Camera of a draw, passed along instead of the globals: draws with different cameras can run side by side
+// on the same thread, and nothing has to be set up again per job.
+struct DrawContext {
+    Matrix view;       // world to eye, the ModelView of a model placed at the origin
+    Matrix projection;
+    Matrix viewport;
+    DrawContext(); // identities
+    DrawContext(const Matrix &view, const Matrix &projection, const Matrix &viewport);
+    static DrawContext current(); // the globals of the calling thread
+    Matrix clip() const { return viewport*projection*view; } // world to screen, before the division by w
+};
+
+// A direction of world space (typically the light) seen from an object placed by transform: the dot products
+// with the normals of the object, normalized once in object space, are the ones of the transformed normals
+// and the direction, as long as transform is a rotation, a uniform scale and a translation.
+Vec3f object_direction(const Matrix &transform, Vec3f dir);
+
+class Model;
+
+// batched vertex stage: every unique vertex of the model is transformed by m exactly once,
+// faces then fetch their corners from out with Model::vert_index()
+void transform_vertices(Model &model, const Matrix &m, std::vector<Vec4f> &out);
+
 struct IShader {
     virtual ~IShader();
     virtual Vec4f vertex(int iface, int nthvert) = 0;
     virtual bool fragment(Vec3f bar, TGAColor &color) = 0;
 };
 
-void triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer);
+Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P);
+// runtime-polymorphic pipeline, the templated triangle<S>() from raster.h is picked for concrete shader types
+void triangle(Vec4f *pts, IShader &shader, TGAImage &image, DepthBuffer &zbuffer);
+void triangle(Vec4f *pts, IShader &shader, TGAImage &image, DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax); // only pixels in [clipmin, clipmax)
+
+const int TILE_SIZE = 64;
+
+// Parallel raster mode: triangles are binned into TILE_SIZE x TILE_SIZE screen tiles and the tiles are
+// rasterized concurrently. Every tile owns its own part of the color and depth buffers, and the triangles
+// of a tile are drawn in submission order, so the result is identical to calling triangle() face by face.
+// The shader is copied per triangle, it must carry all its varyings by value.
+template <typename S> class TiledRaster {
+public:
+    TiledRaster(TGAImage &image, DepthBuffer &zbuffer);
+    void add(Vec4f *pts, const S &shader);
+    void flush(ThreadPool &pool);
+private:
+    struct Triangle {
+        Vec4f pts[3];
+        S shader;
+    };
+    TGAImage &image_;
+    DepthBuffer &zbuffer_;
+    int ntiles_x_;
+    int ntiles_y_;
+    std::vector<Triangle> triangles_;
+    std::vector<std::vector<int> > bins_;
+};
+
+template <typename S> TiledRaster<S>::TiledRaster(TGAImage &image, DepthBuffer &zbuffer) : image_(image), zbuffer_(zbuffer), ntiles_x_(0), ntiles_y_(0), triangles_(), bins_() {
+    ntiles_x_ = (image.get_width() +TILE_SIZE-1)/TILE_SIZE;
+    ntiles_y_ = (image.get_height()+TILE_SIZE-1)/TILE_SIZE;
+    bins_.resize(ntiles_x_*ntiles_y_);
+}
+
+template <typename S> void TiledRaster<S>::add(Vec4f *pts, const S &shader) {
+    STATS_SCOPE();
+    STATS_ADD(triangles_submitted, 1);
+    Vec2i size(image_.get_width(), image_.get_height());
+    Primitive prim; // binned by the bbox of what is left after clipping, every tile clips again on its own
+    if (!assemble_triangle(pts, Vec2i(0, 0), size, size, prim)) {
+        STATS_ADD(triangles_culled, 1);
+        return;
+    }
+    // culled here once rather than in every tile the bbox touches, with a copy of the shader per tile
+    bool culled = prim.clipped || culled_triangle(pts);
+    for (int i=1; prim.clipped && culled && i+1<prim.n; i++) {
+        Vec4f sub[3] = {prim.v[0], prim.v[i], prim.v[i+1]};
+        culled = culled_triangle(sub);
+    }
+    if (culled) {
+        STATS_ADD(triangles_culled, 1);
+        return;
+    }
+    const Vec4f *v = prim.clipped ? prim.v : pts;
+    float bbox[4] = {v[0][0]/v[0][3], v[0][1]/v[0][3], v[0][0]/v[0][3], v[0][1]/v[0][3]};
+    for (int i=1; i<prim.n; i++) {
+        for (int j=0; j<2; j++) {
+            bbox[j]   = std::min(bbox[j],   v[i][j]/v[i][3]);
+            bbox[j+2] = std::max(bbox[j+2], v[i][j]/v[i][3]);
+        }
+    }
+    for (int j=0; j<2; j++) { // the tiles RASTER_FIXED may reach once the vertices are snapped
+        bbox[j]   -= SNAP_SLACK;
+        bbox[j+2] += SNAP_SLACK;
+    }
+    if (!(bbox[2]>=0 && bbox[3]>=0 && bbox[0]<size.x && bbox[1]<size.y)) { // off-screen (or NaN)
+        STATS_ADD(triangles_culled, 1);
+        return;
+    }
+    int tx0 = int(std::max(bbox[0], 0.f))/TILE_SIZE, tx1 = int(std::min(bbox[2], image_.get_width() -1.f))/TILE_SIZE;
+    int ty0 = int(std::max(bbox[1], 0.f))/TILE_SIZE, ty1 = int(std::min(bbox[3], image_.get_height()-1.f))/TILE_SIZE;
+    int id = (int)triangles_.size();
+    triangles_.push_back(Triangle{{pts[0], pts[1], pts[2]}, shader});
+    for (int ty=ty0; ty<=ty1; ty++)
+        for (int tx=tx0; tx<=tx1; tx++)
+            bins_[tx+ty*ntiles_x_].push_back(id);
+}
+
+template <typename S> void TiledRaster<S>::flush(ThreadPool &pool) {
+    pool.parallel_for((int)bins_.size(), [this](int tile) {
+        Vec2i clipmin((tile%ntiles_x_)*TILE_SIZE, (tile/ntiles_x_)*TILE_SIZE);
+        Vec2i clipmax(std::min(clipmin.x+TILE_SIZE, image_.get_width()), std::min(clipmin.y+TILE_SIZE, image_.get_height()));
+        const std::vector<int> &bin = bins_[tile];
+        for (size_t i=0; i<bin.size(); i++) {
+            Triangle &t = triangles_[bin[i]];
+            triangle(t.pts, t.shader, image_, zbuffer_, clipmin, clipmax);
+        }
+    });
+    triangles_.clear();
+    for (size_t i=0; i<bins_.size(); i++) bins_[i].clear();
+}
 
 #endif //__OUR_GL_H__
 
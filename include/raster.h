@@ -0,0 +1,371 @@
+#ifndef __RASTER_H__
+#define __RASTER_H__
+
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "tgaimage.h"
+#include "geometry.h"
+#include "depthbuffer.h"
+#include "stats.h"
+
+// edge equation w(x,y) = a*x + b*y + c, positive inside; times inv_area it is a barycentric coordinate
+struct Edge {
+    float a, b, c;
+};
+
+const int BLOCK_SIZE = DepthBuffer::BLOCK_SIZE; // the raster blocks are the blocks of the hierarchical z-buffer
+
+// evaluates the edges for the BLOCK_SIZE pixels (x..x+7, y) given row = a*x+b*y+c of every edge, a pixel is
+// covered when every edge is > 0, or >= 0 where bias[i] is 0 (the top and left edges); fills bar[i][k] with
+// the i-th barycentric coordinate of pixel x+k, returns the mask of the pixels covered
+inline int row_coverage(const Edge *e, const float *row, const int *bias, float inv_area, float bar[3][BLOCK_SIZE]) {
+#if defined(__AVX__)
+    const __m256 steps = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+    const __m256 scale = _mm256_set1_ps(inv_area);
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int i=0; i<3; i++) {
+        __m256 w = _mm256_add_ps(_mm256_set1_ps(row[i]), _mm256_mul_ps(_mm256_set1_ps(e[i].a), steps));
+        inside = _mm256_and_ps(inside, bias[i] ? _mm256_cmp_ps(w, _mm256_setzero_ps(), _CMP_GT_OQ) : _mm256_cmp_ps(w, _mm256_setzero_ps(), _CMP_GE_OQ));
+        _mm256_storeu_ps(bar[i], _mm256_mul_ps(w, scale));
+    }
+    return _mm256_movemask_ps(inside);
+#elif defined(__SSE2__)
+    const __m128 steps = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    const __m128 scale = _mm_set1_ps(inv_area);
+    __m128 inside_lo = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 inside_hi = inside_lo;
+    for (int i=0; i<3; i++) {
+        __m128 a  = _mm_set1_ps(e[i].a);
+        __m128 lo = _mm_add_ps(_mm_set1_ps(row[i]), _mm_mul_ps(a, steps));
+        __m128 hi = _mm_add_ps(_mm_set1_ps(row[i]), _mm_mul_ps(a, _mm_add_ps(steps, _mm_set1_ps(4.f))));
+        if (bias[i]) {
+            inside_lo = _mm_and_ps(inside_lo, _mm_cmpgt_ps(lo, _mm_setzero_ps()));
+            inside_hi = _mm_and_ps(inside_hi, _mm_cmpgt_ps(hi, _mm_setzero_ps()));
+        } else {
+            inside_lo = _mm_and_ps(inside_lo, _mm_cmpge_ps(lo, _mm_setzero_ps()));
+            inside_hi = _mm_and_ps(inside_hi, _mm_cmpge_ps(hi, _mm_setzero_ps()));
+        }
+        _mm_storeu_ps(bar[i],   _mm_mul_ps(lo, scale));
+        _mm_storeu_ps(bar[i]+4, _mm_mul_ps(hi, scale));
+    }
+    return _mm_movemask_ps(inside_lo) | (_mm_movemask_ps(inside_hi)<<4);
+#else
+    int mask = (1<<BLOCK_SIZE)-1;
+    for (int i=0; i<3; i++) {
+        for (int k=0; k<BLOCK_SIZE; k++) {
+            float w = row[i] + e[i].a*k;
+            bar[i][k] = w*inv_area;
+            if (!(bias[i] ? w>0 : w>=0)) mask &= ~(1<<k);
+        }
+    }
+    return mask;
+#endif
+}
+
+// fixed-point counterpart of row_coverage(): row[i] is the integer edge function i at pixel x and a[i] its
+// step to the next pixel, the pixel is covered when every one of them is >= bias[i]; the barycentric
+// coordinates are the edge functions times inv_area
+template <typename T> inline int row_coverage_fixed(const T *row, const T *a, const int *bias, float inv_area, float bar[3][BLOCK_SIZE]) {
+    int mask = (1<<BLOCK_SIZE)-1;
+    for (int i=0; i<3; i++) {
+        for (int k=0; k<BLOCK_SIZE; k++) {
+            T w = row[i] + a[i]*k;
+            bar[i][k] = (float)w*inv_area;
+            if (w<bias[i]) mask &= ~(1<<k);
+        }
+    }
+    return mask;
+}
+
+// 32-bit edge functions, eight (or twice four) at a time
+inline int row_coverage_fixed(const int32_t *row, const int32_t *a, const int *bias, float inv_area, float bar[3][BLOCK_SIZE]) {
+#if defined(__AVX2__)
+    const __m256i steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 scale = _mm256_set1_ps(inv_area);
+    __m256i inside = _mm256_set1_epi32(-1);
+    for (int i=0; i<3; i++) {
+        __m256i w = _mm256_add_epi32(_mm256_set1_epi32(row[i]), _mm256_mullo_epi32(_mm256_set1_epi32(a[i]), steps));
+        inside = _mm256_and_si256(inside, _mm256_cmpgt_epi32(w, _mm256_set1_epi32(bias[i]-1)));
+        _mm256_storeu_ps(bar[i], _mm256_mul_ps(_mm256_cvtepi32_ps(w), scale));
+    }
+    return _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+#elif defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(inv_area);
+    __m128i inside_lo = _mm_set1_epi32(-1);
+    __m128i inside_hi = inside_lo;
+    for (int i=0; i<3; i++) {
+        __m128i lo = _mm_setr_epi32(row[i], row[i]+a[i], row[i]+2*a[i], row[i]+3*a[i]);
+        __m128i hi = _mm_add_epi32(lo, _mm_set1_epi32(4*a[i]));
+        __m128i threshold = _mm_set1_epi32(bias[i]-1);
+        inside_lo = _mm_and_si128(inside_lo, _mm_cmpgt_epi32(lo, threshold));
+        inside_hi = _mm_and_si128(inside_hi, _mm_cmpgt_epi32(hi, threshold));
+        _mm_storeu_ps(bar[i],   _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(bar[i]+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    return _mm_movemask_ps(_mm_castsi128_ps(inside_lo)) | (_mm_movemask_ps(_mm_castsi128_ps(inside_hi))<<4);
+#else
+    return row_coverage_fixed<int32_t>(row, a, bias, inv_area, bar);
+#endif
+}
+
+enum Cull {
+    CULL_NONE, CULL_BACK, CULL_FRONT
+};
+// Process-wide, like Rasterization: the tiles of TiledRaster and the instances of draw_instanced() are
+// culled on the pool threads. Set it before drawing.
+extern Cull FaceCulling; // CULL_BACK by default, front faces are counterclockwise on screen (y up)
+void face_culling(Cull mode);
+
+// Coverage rule of the rasterizer, both with a top-left fill rule: the pixels along an edge shared by two
+// triangles go to exactly one of them. RASTER_FLOAT tests float edge functions, a shared edge is evaluated
+// from the same ordered pair of vertices by both triangles so that its values are exact opposites in them.
+// RASTER_FIXED snaps the vertices to SUBPIXEL_BITS of fixed point (28.4) and tests exact integer edge
+// functions, only the triangles degenerate once snapped are dropped. Process-wide as FaceCulling is, set it
+// before drawing.
+enum RasterMode {
+    RASTER_FLOAT, RASTER_FIXED
+};
+extern RasterMode Rasterization; // RASTER_FLOAT by default
+void rasterization(RasterMode mode);
+const int SUBPIXEL_BITS = 4;
+// how far RASTER_FIXED may move a vertex by snapping it: the tests that reject triangles from their float
+// positions (frustum, tile binning, bounding volumes) keep that much slack, so as not to lose a triangle
+// the snapping brings onto a row or a column they had ruled out
+const float SNAP_SLACK = .5f/(1<<SUBPIXEL_BITS);
+
+const float NEAR_W     = 1e-2f;  // near plane, w is the distance to the eye over the projection distance
+const float GUARD_BAND = 1024.f; // pixels around the image where the rasterizer copes without clipping
+const int MAX_CLIP_VERTS = 3+5;  // near plane and four guard-band planes
+
+// Primitive assembly output. Most triangles are not clipped and are drawn as given, otherwise v[0..n) is a
+// convex polygon and bar[k] are the barycentric coordinates of v[k] relative to the original triangle.
+struct Primitive {
+    bool clipped;
+    int n;
+    Vec4f v[MAX_CLIP_VERTS];
+    Vec3f bar[MAX_CLIP_VERTS];
+};
+
+// Rejects the triangles entirely outside of the frustum made of the near plane and the clip rectangle,
+// clips the others against the near plane in homogeneous space, and against the guard band around
+// [0, imagesize) when they go beyond it. Returns false if nothing is left to draw.
+bool assemble_triangle(const Vec4f *pts, Vec2i clipmin, Vec2i clipmax, Vec2i imagesize, Primitive &prim);
+
+struct TriangleSetup {
+    Edge e[3];     // the edge opposite to the vertex i gives the i-th barycentric coordinate, times inv_area
+    float nearest; // closest depth of the triangle
+    int xmin, xmax, ymin, ymax; // pixels to scan, inclusive
+    // RASTER_FIXED, instead of e: the edge functions a*x + b*y + c at pixel (x, y) are the barycentric
+    // coordinates times the area, in 1/256 pixels squared; covered when all of them are >= bias
+    bool fixed;
+    bool wide; // the edge functions may not fit in 32 bits over the scanned blocks
+    int64_t a[3], b[3], c[3];
+    int32_t a32[3], b32[3];
+    int bias[3]; // 0 on the top and left edges, 1 on the others (both modes)
+    float inv_area;
+    bool culled; // when the setup fails: degenerate or facing the culled way, rather than out of the clip rectangle
+};
+
+// per-triangle part of the rasterizer, returns false if there is nothing to draw in [clipmin, clipmax)
+// or if the triangle faces the culled way; the scan range is clamped to the clip rectangle, and covers the
+// pixels up to margin pixels away from the triangle (their samples may be inside when multisampling)
+bool setup_triangle(const Vec4f *pts, const DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax, TriangleSetup &t, float margin=0);
+
+// the culling test of setup_triangle() alone: true when the triangle is degenerate or faces the culled way,
+// for triangles with every w>0 (unclipped or pieces of a clipped one)
+bool culled_triangle(const Vec4f *pts);
+
+// depth test and write of the pixels of mask in zrow[0..BLOCK_SIZE) given their barycentric coordinates,
+// returns the mask of the written ones; vector loads and stores of the whole row when wide is set
+inline int depth_row(const Vec4f *pts, const float bar[3][BLOCK_SIZE], int mask, const DepthBuffer &zbuffer, float *zrow, bool wide) {
+    int written = 0;
+#if defined(__SSE2__)
+    if (wide) {
+        const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+        __m128 pz[3], pw[3];
+        for (int i=0; i<3; i++) {
+            pz[i] = _mm_set1_ps(pts[i][2]);
+            pw[i] = _mm_set1_ps(pts[i][3]);
+        }
+        for (int k=0; k<BLOCK_SIZE; k+=4) {
+            __m128 b0 = _mm_loadu_ps(bar[0]+k), b1 = _mm_loadu_ps(bar[1]+k), b2 = _mm_loadu_ps(bar[2]+k);
+            __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pz[0], b0), _mm_mul_ps(pz[1], b1)), _mm_mul_ps(pz[2], b2));
+            __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pw[0], b0), _mm_mul_ps(pw[1], b1)), _mm_mul_ps(pw[2], b2));
+            __m128 depth = _mm_div_ps(z, w);
+            __m128 old = _mm_loadu_ps(zrow+k);
+            __m128 pass = zbuffer.reversed() ? _mm_cmpgt_ps(depth, old) : _mm_cmplt_ps(depth, old);
+            __m128i covered = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask>>k), bits), bits);
+            pass = _mm_and_ps(pass, _mm_castsi128_ps(covered));
+            _mm_storeu_ps(zrow+k, _mm_or_ps(_mm_and_ps(pass, depth), _mm_andnot_ps(pass, old)));
+            written |= _mm_movemask_ps(pass)<<k;
+        }
+        return written;
+    }
+#else
+    (void)wide;
+#endif
+    for (int k=0; mask; k++, mask>>=1) {
+        if (!(mask&1)) continue;
+        float z = pts[0][2]*bar[0][k] + pts[1][2]*bar[1][k] + pts[2][2]*bar[2][k];
+        float w = pts[0][3]*bar[0][k] + pts[1][3]*bar[1][k] + pts[2][3]*bar[2][k];
+        float depth = z/w;
+        if (!zbuffer.closer(depth, zrow[k])) continue;
+        zrow[k] = depth;
+        written |= 1<<k;
+    }
+    return written;
+}
+
+// The fragment of the depth-only draws, for the shadow maps and the depth pre-passes: no shading and no
+// color. rasterize_triangle() writes the depth of a whole row of a block at once with depth_row() for it,
+// the rows are read and stored back whole, so concurrent draws into one buffer need clip rectangles aligned
+// on BLOCK_SIZE.
+struct DepthOnly {
+    bool operator()(int, int, const Vec3f &) const { return true; }
+};
+
+// Scan conversion of one triangle of the assembled primitive. fragment(x, y, bar) is called for every covered
+// pixel that passes the depth test and returns false to discard, the depth is written otherwise. When remap
+// is given, pts is a piece of a clipped triangle and remap[i] are the barycentric coordinates of pts[i]
+// relative to the original one, bar is then relative to the original triangle, whose vertices the varyings
+// refer to.
+template <typename F> void rasterize_triangle(const Vec4f *pts, const Vec3f *remap, DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax, F &fragment) {
+    STATS_SCOPE();
+    TriangleSetup t;
+    if (!setup_triangle(pts, zbuffer, clipmin, clipmax, t)) {
+        STATS_ADD(triangles_culled, t.culled);
+        return;
+    }
+    const Edge *e = t.e;
+    float bar[3][BLOCK_SIZE];
+    // the blocks are aligned on a global grid, this way a pixel gets exactly the same barycentric
+    // coordinates whatever the clip rectangle is, and the tiled raster mode matches the serial one
+    for (int by=t.ymin&~(BLOCK_SIZE-1); by<=t.ymax; by+=BLOCK_SIZE) {
+        for (int bx=t.xmin&~(BLOCK_SIZE-1); bx<=t.xmax; bx+=BLOCK_SIZE) {
+            bool outside = false; // the whole 8x8 block is on the wrong side of an edge
+            float row[3];
+            int64_t row64[3];
+            int32_t row32[3];
+            for (int i=0; !outside && i<3; i++) {
+                if (t.fixed) {
+                    row64[i] = t.a[i]*bx + t.b[i]*by + t.c[i];
+                    row32[i] = (int32_t)row64[i];
+                    outside = row64[i] + std::max<int64_t>(0, t.a[i]*(BLOCK_SIZE-1)) + std::max<int64_t>(0, t.b[i]*(BLOCK_SIZE-1)) < t.bias[i];
+                } else {
+                    row[i] = e[i].a*bx + e[i].b*by + e[i].c;
+                    outside = row[i] + std::max(0.f, e[i].a*(BLOCK_SIZE-1)) + std::max(0.f, e[i].b*(BLOCK_SIZE-1)) < 0;
+                }
+            }
+            if (outside || !zbuffer.closer(t.nearest, zbuffer.block_far(bx/BLOCK_SIZE, by/BLOCK_SIZE))) {
+                STATS_ADD(blocks_rejected, 1);
+                continue;
+            }
+            bool written = false;
+            int columns = (1<<BLOCK_SIZE)-1;
+            if (bx<t.xmin) columns &= ~((1<<(t.xmin-bx))-1);
+            if (t.xmax-bx+1<BLOCK_SIZE) columns &= (1<<(t.xmax-bx+1))-1;
+            for (int y=by; y<=std::min(t.ymax, by+BLOCK_SIZE-1); y++) {
+                int mask = 0;
+                if (y>=t.ymin) {
+                    if (!t.fixed)    mask = row_coverage(e, row, t.bias, t.inv_area, bar);
+                    else if (t.wide) mask = row_coverage_fixed(row64, t.a,   t.bias, t.inv_area, bar);
+                    else             mask = row_coverage_fixed(row32, t.a32, t.bias, t.inv_area, bar);
+                    mask &= columns;
+                }
+                STATS_ADD(pixels_tested, y<t.ymin ? 0 : __builtin_popcount(columns));
+                for (int i=0; i<3; i++) {
+                    if (!t.fixed)    row[i]   += e[i].b;
+                    else if (t.wide) row64[i] += t.b[i];
+                    else             row32[i] += t.b32[i];
+                }
+                if (!mask) continue;
+                if constexpr (std::is_same<F, DepthOnly>::value) {
+                    int passed = depth_row(pts, bar, mask, zbuffer, zbuffer.row(y)+bx, bx+BLOCK_SIZE<=zbuffer.get_width());
+                    STATS_ADD(depth_failed, __builtin_popcount(mask)-__builtin_popcount(passed));
+                    written = written || passed;
+                    continue;
+                }
+                float *zrow = zbuffer.row(y);
+                for (int k=0; mask; k++, mask>>=1) {
+                    if (!(mask&1)) continue;
+                    int x = bx+k;
+                    Vec3f c(bar[0][k], bar[1][k], bar[2][k]);
+                    float z = pts[0][2]*c.x + pts[1][2]*c.y + pts[2][2]*c.z;
+                    float w = pts[0][3]*c.x + pts[1][3]*c.y + pts[2][3]*c.z;
+                    float frag_depth = z/w;
+                    if (!zbuffer.closer(frag_depth, zrow[x])) {
+                        STATS_ADD(depth_failed, 1);
+                        continue;
+                    }
+                    if (remap) c = remap[0]*c.x + remap[1]*c.y + remap[2]*c.z;
+                    bool kept = fragment(x, y, c);
+                    STATS_ADD(fragments_shaded, 1);
+                    STATS_ADD(discarded, !kept);
+                    STATS_HEAT(x, y);
+                    if (kept) {
+                        zrow[x] = frag_depth;
+                        written = true;
+                    }
+                }
+            }
+            if (written) zbuffer.touch(bx/BLOCK_SIZE, by/BLOCK_SIZE);
+        }
+    }
+}
+
+// primitive assembly, then raster(pts, remap) on the triangle as given or on every piece of the clipped one,
+// with the arguments of rasterize_triangle()
+template <typename R> void draw_primitive(const Vec4f *pts, Vec2i imagesize, Vec2i clipmin, Vec2i clipmax, R raster) {
+    Primitive prim;
+    if (!assemble_triangle(pts, clipmin, clipmax, imagesize, prim)) {
+        STATS_SCOPE();
+        STATS_ADD(triangles_culled, 1);
+        return;
+    }
+    if (!prim.clipped) {
+        raster(pts, (const Vec3f *)NULL);
+        return;
+    }
+    for (int i=1; i+1<prim.n; i++) { // the clipped polygon is convex, split into a fan
+        Vec4f sub[3] = {prim.v[0],   prim.v[i],   prim.v[i+1]};
+        Vec3f bar[3] = {prim.bar[0], prim.bar[i], prim.bar[i+1]};
+        raster(sub, bar);
+    }
+}
+
+// primitive assembly then scan conversion of the pieces, see rasterize_triangle() for fragment
+template <typename F> void draw_triangle(const Vec4f *pts, Vec2i imagesize, DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax, F &fragment) {
+    draw_primitive(pts, imagesize, clipmin, clipmax, [&](const Vec4f *v, const Vec3f *remap) {
+        rasterize_triangle(v, remap, zbuffer, clipmin, clipmax, fragment);
+    });
+}
+
+// depth-only draw_triangle() over the whole zbuffer, see DepthOnly
+void depth_triangle(const Vec4f *pts, DepthBuffer &zbuffer);
+
+// The shader is a static type here: for a concrete S the fragment call is bound at compile time and can be
+// inlined into the pixel loop. Only an abstract S (IShader itself) goes through the virtual call, and in that
+// case S must be the static type of the whole object, no further overriding is taken into account.
+template <typename S> void triangle(Vec4f *pts, S &shader, TGAImage &image, DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax) {
+    TGAColor color;
+    auto shade = [&](int x, int y, const Vec3f &bar) {
+        bool discard;
+        if constexpr (std::is_abstract<S>::value) discard = shader.fragment(bar, color);
+        else discard = shader.S::fragment(bar, color);
+        if (!discard) image.set(x, y, color);
+        return !discard;
+    };
+    draw_triangle(pts, Vec2i(image.get_width(), image.get_height()), zbuffer, clipmin, clipmax, shade);
+}
+
+template <typename S> void triangle(Vec4f *pts, S &shader, TGAImage &image, DepthBuffer &zbuffer) {
+    STATS_SCOPE();
+    STATS_ADD(triangles_submitted, 1);
+    triangle(pts, shader, image, zbuffer, Vec2i(0, 0), Vec2i(image.get_width(), image.get_height()));
+}
+
+#endif //__RASTER_H__
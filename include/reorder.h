@@ -0,0 +1,24 @@
+#ifndef __REORDER_H__
+#define __REORDER_H__
+
+#include <vector>
+#include "geometry.h"
+
+const int VERTEX_CACHE_SIZE = 16; // entries of the FIFO post-transform cache simulated by acmr()
+
+// Average cache miss ratio of faces [first, first+nfaces): the vertices transformed per triangle through a
+// FIFO post-transform cache of cache_size entries. 3 is no reuse at all, about .5 is the best a large
+// regular mesh can do.
+float acmr(const std::vector<Vec3i> &corners, int first, int nfaces, int cache_size=VERTEX_CACHE_SIZE);
+
+// Reorders faces [first, first+nfaces) of corners (three per face, as in ObjData) for locality. The faces
+// are sorted along a Morton curve through their centroids, then Tipsify (Sander, Nehab and Barczak, 2007)
+// emits them fan after fan around the vertices still in the cache, jumping along the curve when it runs
+// into a dead end. The corners of a face stay together, in the same order: the winding does not change.
+void reorder_faces(const std::vector<Vec3f> &verts, std::vector<Vec3i> &corners, int first, int nfaces, int cache_size=VERTEX_CACHE_SIZE);
+
+// Renumbers the vertices, uvs and normals in the order the corners first use them, so that the vertex
+// fetches follow the faces. Entries no corner uses go to the end.
+void reorder_vertices(std::vector<Vec3f> &verts, std::vector<Vec2f> &uv, std::vector<Vec3f> &norms, std::vector<Vec3i> &corners);
+
+#endif //__REORDER_H__
@@ -0,0 +1,102 @@
+#ifndef __SHADERS_H__
+#define __SHADERS_H__
+
+#include <cmath>
+#include <algorithm>
+#include "model.h"
+#include "geometry.h"
+#include "our_gl.h"
+#include "shadow.h"
+
+extern Model *model;     // the scene of main() and of the benchmarks, shaders only see their uniform_model
+extern Vec3f light_dir;
+
+struct GouraudShader : public IShader {
+    Model *uniform_model;
+    const Vec4f *uniform_verts;     // vertices transformed by Viewport*Projection*ModelView
+    const float *uniform_intensity; // lighting of every normal of the model
+    Vec3f varying_intensity; 
+
+    virtual Vec4f vertex(int iface, int nthvert) {
+        varying_intensity[nthvert] = uniform_intensity[uniform_model->normal_index(iface, nthvert)];
+        return uniform_verts[uniform_model->vert_index(iface, nthvert)];
+    }
+
+    virtual bool fragment(Vec3f bar, TGAColor &color) {
+        float intensity = varying_intensity*bar;   
+        color = TGAColor(255, 255, 255)*intensity; 
+        return false;                              
+    }
+};
+
+struct CelShader : public IShader {
+    Model *uniform_model;
+    const Vec4f *uniform_verts;     // vertices transformed by Viewport*ModelView
+    const float *uniform_intensity; // lighting of every normal of the model
+    Vec3f varying_intensity; 
+
+    virtual Vec4f vertex(int iface, int nthvert) {
+        varying_intensity[nthvert] = uniform_intensity[uniform_model->normal_index(iface, nthvert)];
+        return uniform_verts[uniform_model->vert_index(iface, nthvert)];
+    }
+
+    virtual bool fragment(Vec3f bar, TGAColor &color) {
+        float intensity = varying_intensity*bar;
+        if (intensity>.85) intensity = 1;
+        else if (intensity>.50) intensity = .80;
+        else if (intensity>.25) intensity = .30;
+        else intensity = 0;
+        color = TGAColor(130, 100, 230)*intensity;
+        return false;
+    }
+};
+
+
+struct Shader : public IShader {
+    Model *uniform_model;
+    const Vec4f *uniform_verts; // vertices transformed by Viewport*Projection*ModelView
+    Vec3f uniform_light_dir;
+    mat<2,3,float> varying_uv;  
+    mat<4,4,float> uniform_M;   
+    mat<4,4,float> uniform_MIT; 
+    Vec2f varying_xy[3];        // screen positions
+    Vec2f varying_duvdx;        // uv derivatives, they select the mip level of the textures
+    Vec2f varying_duvdy;
+    const ShadowMap *uniform_shadow = NULL;   // no shadows unless given
+    const Vec4f *uniform_shadow_verts = NULL; // vertices transformed by the matrix() of the shadow map
+    mat<4,3,float> varying_shadow;            // positions in the shadow map
+
+    virtual Vec4f vertex(int iface, int nthvert) {
+        varying_uv.set_col(nthvert, uniform_model->uv(iface, nthvert));
+        int ivert = uniform_model->vert_index(iface, nthvert);
+        if (uniform_shadow) varying_shadow.set_col(nthvert, uniform_shadow_verts[ivert]);
+        Vec4f gl_Vertex = uniform_verts[ivert];
+        varying_xy[nthvert] = Vec2f(gl_Vertex[0]/gl_Vertex[3], gl_Vertex[1]/gl_Vertex[3]);
+        if (2==nthvert) {
+            Vec2f uv[3] = {varying_uv.col(0), varying_uv.col(1), varying_uv.col(2)};
+            uv_derivatives(varying_xy, uv, varying_duvdx, varying_duvdy);
+        }
+        return gl_Vertex;
+    }
+
+    virtual bool fragment(Vec3f bar, TGAColor &color) {
+        Vec2f uv = varying_uv*bar;
+        Vec3f n = proj<3>(uniform_MIT*embed<4>(uniform_model->normal(uv, varying_duvdx, varying_duvdy))).normalize();
+        Vec3f l = proj<3>(uniform_M  *embed<4>(uniform_light_dir)).normalize();
+        Vec3f r = (n*(n*l*2.f) - l).normalize();   
+        float spec = pow(std::max(r.z, 0.0f), uniform_model->specular(uv, varying_duvdx, varying_duvdy));
+        float diff = std::max(0.f, n*l);
+        float shadow = 1.f;
+        if (uniform_shadow) { // a bias of 4 texels keeps the acne off the lit surfaces
+            Vec4f p = varying_shadow*bar;
+            shadow = .3f + .7f*uniform_shadow->lit(Vec3f(p[0]/p[3], p[1]/p[3], p[2]/p[3]), 4.f*uniform_shadow->texel_depth());
+        }
+        TGAColor c = uniform_model->diffuse(uv, varying_duvdx, varying_duvdy);
+        color = c;
+        for (int i=0; i<3; i++) color[i] = std::min<float>(5 + c[i]*shadow*(diff + .6*spec), 255);
+        return false;
+    }
+};
+
+#endif //__SHADERS_H__
+
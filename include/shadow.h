@@ -0,0 +1,42 @@
+#ifndef __SHADOW_H__
+#define __SHADOW_H__
+
+#include "geometry.h"
+#include "depthbuffer.h"
+
+class Model;
+
+// Depth of the scene seen from a directional light, through an orthographic view fitted around a bounding
+// sphere. It is drawn by depth-only draws (depth_triangle(): no color, no shader), and the shaders test
+// their fragments against it with lit().
+class ShadowMap {
+public:
+    static const int PCF_RADIUS = 1; // lit() filters (2*PCF_RADIUS+1)^2 texels
+
+    ShadowMap(int size); // size x size texels
+    int size() const { return size_; }
+    // the light comes from dir, shadows are cast within the sphere (center, radius)
+    void look(Vec3f dir, Vec3f center, float radius);
+    const Matrix &matrix() const { return light_; } // world to the screen of the map, w stays 1
+    void clear();
+
+    // depth pass of the faces of a level of detail of model, verts are its vertices transformed by matrix()
+    // (times the placement of the model); the faces are culled by FaceCulling like any other draw
+    void draw(Model &model, const Vec4f *verts, int level=0);
+
+    // Fraction of the light that reaches p, a position in the screen of the map: 1 lit, 0 in the shadow.
+    // Percentage closer filtering, the depth tests of the texels around p weighted by a box filter of
+    // 2*PCF_RADIUS+1 texels convolved with the bilinear one, so the shadow edges move smoothly with p.
+    // p is occluded by the texels closer to the light than p by more than bias.
+    float lit(Vec3f p, float bias) const;
+    // depth difference between two neighbor texels of a surface at 45 degrees to the light, the unit of bias
+    float texel_depth() const { return 1.f/size_; }
+
+    const DepthBuffer &depth() const { return depth_; }
+private:
+    int size_;
+    Matrix light_;
+    DepthBuffer depth_;
+};
+
+#endif //__SHADOW_H__
@@ -0,0 +1,25 @@
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__
+
+#include <vector>
+#include "geometry.h"
+
+const int MAX_LODS = 8;        // level 0 included
+const int MIN_LOD_FACES = 64;  // no level is made smaller than that
+
+struct LodLevel {
+    int first;   // first face of the level in the corners of the chain
+    int nfaces;
+    float error; // object space, about the largest distance to the surface of level 0
+};
+
+// Level of detail chain by quadric error metric simplification. The mesh is given as in ObjData: vertex
+// positions and three corners (vertex/uv/normal indices, all valid) per triangle. Level 0 is the mesh
+// itself, every next level has about a quarter of the faces of the one before; their faces are appended
+// to corners. The simplification only does half-edge collapses, a vertex either stays where it is or goes
+// away, so the levels reference the very same vertex, uv and normal arrays as level 0 and the texture
+// lookups stay valid. A vertex on a uv or normal seam only collapses along the seam, onto the matching
+// corners on both sides; seams and open borders are held in place by extra planes in the quadrics.
+void build_lod_chain(const std::vector<Vec3f> &verts, std::vector<Vec3i> &corners, std::vector<LodLevel> &levels);
+
+#endif //__SIMPLIFY_H__
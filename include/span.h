@@ -0,0 +1,22 @@
+#ifndef __SPAN_H__
+#define __SPAN_H__
+
+#include <cassert>
+#include <cstddef>
+
+// non-owning view of a contiguous array
+template <typename T> class Span {
+    T *data_;
+    size_t size_;
+public:
+    Span() : data_(NULL), size_(0) {}
+    Span(T *data, size_t size) : data_(data), size_(size) {}
+    T *data()  const { return data_; }
+    size_t size() const { return size_; }
+    T *begin() const { return data_; }
+    T *end()   const { return data_+size_; }
+    T &operator[](const size_t i) const { assert(i<size_); return data_[i]; }
+};
+
+#endif //__SPAN_H__
+
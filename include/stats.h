@@ -0,0 +1,79 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+// Pipeline instrumentation, compiled in with -DTINYRENDERER_STATS=ON (cmake option). Compiled out, every macro
+// below expands to nothing, the hot loops are exactly the uninstrumented ones.
+//
+//   STATS_SCOPE()          binds the counters of the calling thread, once per function using STATS_ADD
+//   STATS_ADD(counter, n)  adds n to one of the PipelineStats counters
+//   STATS_HEAT(x, y)       one more fragment shaded at pixel (x, y) of the heatmap, if one is being recorded
+//   STATS_TIMER(stage)     adds the time until the end of the enclosing block to the stage (monotonic clock)
+
+#ifdef TINYRENDERER_STATS
+
+#include <vector>
+#include <chrono>
+#include "tgaimage.h"
+
+enum Stage {
+    STAGE_VERTEX, STAGE_RASTER, STAGE_OUTPUT, STAGE_COUNT
+};
+
+struct PipelineStats {
+    long vertices;            // transformed by the vertex stage
+    long triangles_submitted; // given to the rasterizer
+    long triangles_culled;    // out of the view, degenerate or facing the culled way, once per submitted triangle
+    long blocks_rejected;     // 8x8 blocks skipped by the edge or the hierarchical-z test
+    long pixels_tested;       // bounding-box pixels evaluated against the edges
+    long fragments_shaded;
+    long depth_failed;
+    long discarded;           // fragments the shader discarded
+    long stage_ns[STAGE_COUNT]; // summed over the threads that ran the stage
+};
+
+PipelineStats &pipeline_stats();  // the calling thread's counters
+PipelineStats stats_total();      // sum over every thread
+void stats_reset();
+
+struct Heatmap {
+    std::vector<unsigned int> counts;
+    int width;
+};
+extern Heatmap stats_heatmap;    // shaded fragments per pixel, one image at a time (the tiles never share a pixel)
+void stats_heatmap_begin(int width, int height);
+TGAImage stats_heatmap_image();  // black, blue, green, yellow, red as the overdraw grows to its maximum
+
+bool stats_write_json(const char *filename); // "-" is stdout
+
+inline void stats_heat(int x, int y) {
+    if (!stats_heatmap.counts.empty()) stats_heatmap.counts[x+y*stats_heatmap.width]++;
+}
+
+class StageTimer {
+public:
+    StageTimer(Stage stage) : stage_(stage), start_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        pipeline_stats().stage_ns[stage_] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start_).count();
+    }
+private:
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_SCOPE() PipelineStats &stats_ = pipeline_stats()
+#define STATS_ADD(counter, n) (stats_.counter += (n))
+#define STATS_HEAT(x, y) stats_heat(x, y)
+#define STATS_TIMER(stage) StageTimer STATS_CONCAT(stage_timer_, __LINE__)(stage)
+
+#else
+
+#define STATS_SCOPE() ((void)0)
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_HEAT(x, y) ((void)0)
+#define STATS_TIMER(stage) ((void)0)
+
+#endif
+
+#endif //__STATS_H__
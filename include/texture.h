@@ -0,0 +1,45 @@
+#ifndef __TEXTURE_H__
+#define __TEXTURE_H__
+
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+
+// Read-only texture with a full mip chain. Every level is stored in 8x8 texel tiles, texels follow the
+// Morton order inside a tile and tiles are laid out row by row, so a bilinear footprint touches one or
+// two cache lines instead of two rows a whole texture width apart.
+class Texture {
+public:
+    enum Filter {
+        NEAREST, BILINEAR, TRILINEAR
+    };
+
+    Texture();
+    void build(TGAImage &img); // level 0 is a copy of img, the other levels are 2x2 box-filtered
+    bool empty() const { return levels_.empty(); }
+    int get_width()  const { return empty() ? 0 : levels_[0].width;  }
+    int get_height() const { return empty() ? 0 : levels_[0].height; }
+    int nlevels() const { return (int)levels_.size(); }
+
+    TGAColor get(int level, int x, int y) const; // black outside of the level, like TGAImage::get
+    TGAColor sample(Vec2f uv, float lod, Filter filter) const;
+    float lod(Vec2f duvdx, Vec2f duvdy) const; // level of detail from the uv derivatives along the screen axes
+private:
+    struct Level {
+        int width, height;
+        int ntiles_x;
+        std::vector<unsigned char> texels; // 4 bytes per texel whatever bytespp is
+    };
+    const unsigned char *texel(const Level &l, int x, int y) const; // unchecked
+    TGAColor bilinear(int level, Vec2f uv) const;
+
+    std::vector<Level> levels_;
+    int bytespp_;
+};
+
+// derivatives of the uv coordinates along the screen x and y axes for the triangle with screen vertices s,
+// exact for this rasterizer which interpolates the varyings linearly in screen space
+void uv_derivatives(const Vec2f s[3], const Vec2f uv[3], Vec2f &duvdx, Vec2f &duvdy);
+
+#endif //__TEXTURE_H__
+
@@ -2,6 +2,7 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include "framebufferpool.h"
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -63,15 +64,21 @@ struct TGAColor {
 };
 
 
+// Owns its pixels unless it is a TGAView. Owned pixels come from the FramebufferPool given at
+// construction (and go back to it), or from a plain aligned allocation when there is none.
 class TGAImage {
 protected:
     unsigned char* data;
     int width;
     int height;
     int bytespp;
+    FramebufferPool *pool;
+    bool owned;
 
-    bool   load_rle_data(std::ifstream &in);
+    bool   load_rle_data(const unsigned char *in, size_t size);
     bool unload_rle_data(std::ofstream &out);
+    unsigned char *allocate(unsigned long nbytes);
+    void release();
 public:
     enum Format {
         GRAYSCALE=1, RGB=3, RGBA=4
@@ -79,9 +86,11 @@ public:
 
     TGAImage();
     TGAImage(int w, int h, int bpp);
+    TGAImage(int w, int h, int bpp, FramebufferPool &fbpool);
     TGAImage(const TGAImage &img);
+    TGAImage(TGAImage &&img);
     bool read_tga_file(const char *filename);
-    bool write_tga_file(const char *filename, bool rle=true);
+    bool write_tga_file(const char *filename, bool rle=true, bool flip=false); // flip: rows are stored bottom-up
     bool flip_horizontally();
     bool flip_vertically();
     bool scale(int w, int h);
@@ -90,6 +99,7 @@ public:
     bool set(int x, int y, const TGAColor &c);
     ~TGAImage();
     TGAImage & operator =(const TGAImage &img);
+    TGAImage & operator =(TGAImage &&img);
     int get_width();
     int get_height();
     int get_bytespp();
@@ -97,5 +107,17 @@ public:
     void clear();
 };
 
+// Non-owning image over external memory (a mapped file, a pool buffer, someone else's frame), tightly
+// packed rows of w*bpp bytes. Copies of a view alias the same memory. Anything that reallocates (scale,
+// read_tga_file, assigning an image to it) detaches it into an owned image.
+class TGAView : public TGAImage {
+public:
+    TGAView(unsigned char *pixels, int w, int h, int bpp);
+    explicit TGAView(TGAImage &img); // over the pixels of img
+    TGAView(const TGAView &view);
+    TGAView & operator =(const TGAView &view);
+    TGAView & operator =(const TGAImage &img); // a copy of img, owned
+};
+
 #endif //__IMAGE_H__
 
@@ -0,0 +1,43 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+// fixed set of worker threads; parallel_for() hands out indices 0..n-1 in contiguous
+// blocks, one block per thread, and idle threads steal from the back of the others' blocks
+class ThreadPool {
+public:
+    ThreadPool(int nthreads=0); // 0 means one thread per hardware core
+    ~ThreadPool();
+    int size() const;
+    void parallel_for(int n, const std::function<void(int)> &task);
+    static ThreadPool &shared(); // process-wide pool with one thread per core, created on first use
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> items;
+    };
+    void worker(int id);
+    void run(int id, const std::function<void(int)> &task);
+    bool pop(int id, int &item);
+
+    std::vector<std::thread> threads_;
+    std::vector<std::unique_ptr<Queue> > queues_; // one per worker, the last one belongs to the calling thread
+    std::mutex submit_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(int)> *task_;
+    unsigned long generation_;
+    int busy_;
+    bool quit_;
+};
+
+#endif //__THREADPOOL_H__
+
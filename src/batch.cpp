@@ -0,0 +1,164 @@
+#include <map>
+#include <chrono>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include "batch.h"
+#include "model.h"
+#include "shaders.h"
+#include "stats.h"
+
+BatchJob::BatchJob() : model("obj/african_head.obj"), eye(0, 0, 3), center(0, 0, 0), up(0, 1, 0), light(1, 1, 1),
+    shader("gouraud"), width(800), height(800), lod(0), shadow(0), output() {
+    output.parse("frame%04d.tga");
+}
+
+static bool parse_vec3(const std::string &s, Vec3f &v) {
+    return 3==sscanf(s.c_str(), "%f,%f,%f", &v.x, &v.y, &v.z);
+}
+
+bool read_manifest(const char *filename, std::vector<BatchJob> &jobs) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "can't open manifest " << filename << "\n";
+        return false;
+    }
+    BatchJob job;
+    std::string line;
+    for (int lineno=1; std::getline(in, line); lineno++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        std::string token;
+        bool any = false;
+        while (iss >> token) {
+            size_t eq = token.find('=');
+            std::string key = token.substr(0, eq), value = eq==std::string::npos ? "" : token.substr(eq+1);
+            bool ok = true;
+            if      ("model" ==key) job.model  = value;
+            else if ("shader"==key) job.shader = value;
+            else if ("out"   ==key) ok = job.output.parse(value);
+            else if ("eye"   ==key) ok = parse_vec3(value, job.eye);
+            else if ("center"==key) ok = parse_vec3(value, job.center);
+            else if ("up"    ==key) ok = parse_vec3(value, job.up);
+            else if ("light" ==key) ok = parse_vec3(value, job.light);
+            else if ("size"  ==key) ok = 2==sscanf(value.c_str(), "%dx%d", &job.width, &job.height) && job.width>0 && job.height>0;
+            else if ("lod"   ==key) ok = 1==sscanf(value.c_str(), "%f", &job.lod) && job.lod>=0;
+            else if ("shadow"==key) ok = 1==sscanf(value.c_str(), "%d", &job.shadow) && (0==job.shadow || job.shadow>=16);
+            else ok = false;
+            if (!ok || value.empty()) {
+                std::cerr << filename << ":" << lineno << ": bad entry " << token << "\n";
+                return false;
+            }
+            any = true;
+        }
+        if (any) jobs.push_back(job);
+    }
+    return true;
+}
+
+// serial, the concurrency is across jobs; draws the faces of the given level of detail
+template <typename S> static void draw(S &shader, Model &m, int level, TGAImage &image, DepthBuffer &zbuffer) {
+    STATS_TIMER(STAGE_RASTER);
+    int first = m.lod_first_face(level), last = first+m.lod_nfaces(level);
+    for (int i=first; i<last; i++) {
+        Vec4f screen_coords[3];
+        for (int j=0; j<3; j++) screen_coords[j] = shader.S::vertex(i, j);
+        triangle(screen_coords, shader, image, zbuffer);
+    }
+}
+
+static bool render_job(const BatchJob &job, int index, Model &m) {
+    DrawContext ctx(lookat_matrix(job.eye, job.center, job.up), projection_matrix(-1.f/(job.eye-job.center).norm()),
+                    viewport_matrix(job.width/8, job.height/8, job.width*3/4, job.height*3/4));
+    Vec3f light = job.light;
+    light.normalize();
+
+    TGAImage image(job.width, job.height, TGAImage::RGB, FramebufferPool::shared());
+    DepthBuffer zbuffer(job.width, job.height);
+    int level = job.lod>0 ? m.select_lod(ctx.clip(), job.lod) : 0;
+    std::vector<Vec4f> verts;
+    std::vector<float> intensity;
+    if ("gouraud"==job.shader || "cel"==job.shader) {
+        intensity.resize(m.nnormals());
+        for (int i=0; i<m.nnormals(); i++) intensity[i] = std::max(0.f, m.normal(i)*light);
+    }
+    if ("gouraud"==job.shader) {
+        {
+            STATS_TIMER(STAGE_VERTEX);
+            transform_vertices(m, ctx.clip(), verts);
+        }
+        GouraudShader shader;
+        shader.uniform_model     = &m;
+        shader.uniform_verts     = verts.data();
+        shader.uniform_intensity = intensity.data();
+        draw(shader, m, level, image, zbuffer);
+    } else if ("cel"==job.shader) {
+        {
+            STATS_TIMER(STAGE_VERTEX);
+            transform_vertices(m, ctx.viewport*ctx.view, verts);
+        }
+        CelShader shader;
+        shader.uniform_model     = &m;
+        shader.uniform_verts     = verts.data();
+        shader.uniform_intensity = intensity.data();
+        draw(shader, m, level, image, zbuffer);
+    } else if ("normalmap"==job.shader) {
+        {
+            STATS_TIMER(STAGE_VERTEX);
+            transform_vertices(m, ctx.clip(), verts);
+        }
+        Shader shader;
+        shader.uniform_model     = &m;
+        shader.uniform_verts     = verts.data();
+        shader.uniform_light_dir = light;
+        shader.uniform_M         =  ctx.projection*ctx.view;
+        shader.uniform_MIT       = (ctx.projection*ctx.view).invert_transpose();
+        std::unique_ptr<ShadowMap> shadow(job.shadow ? new ShadowMap(job.shadow) : NULL);
+        std::vector<Vec4f> shadow_verts;
+        if (shadow) { // the light sees the whole model, whatever the camera sees
+            {
+                STATS_TIMER(STAGE_VERTEX);
+                shadow->look(light, (m.bbox_min()+m.bbox_max())*.5f, (m.bbox_max()-m.bbox_min()).norm()*.5f);
+                transform_vertices(m, shadow->matrix(), shadow_verts);
+            }
+            STATS_TIMER(STAGE_RASTER);
+            shadow->draw(m, shadow_verts.data(), level);
+            shader.uniform_shadow       = shadow.get();
+            shader.uniform_shadow_verts = shadow_verts.data();
+        }
+        draw(shader, m, level, image, zbuffer);
+    } else {
+        std::cerr << "unknown shader " << job.shader << "\n";
+        return false;
+    }
+    STATS_TIMER(STAGE_OUTPUT);
+    return image.write_tga_file(job.output.name(index).c_str(), true, true);
+}
+
+int run_batch(const std::vector<BatchJob> &jobs, ThreadPool &pool) {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+    std::map<std::string, std::unique_ptr<Model> > models;
+    for (size_t i=0; i<jobs.size(); i++) {
+        std::unique_ptr<Model> &m = models[jobs[i].model];
+        if (!m) m.reset(new Model(jobs[i].model.c_str()));
+    }
+    clock::time_point loaded = clock::now();
+
+    std::vector<char> ok(jobs.size(), 0);
+    pool.parallel_for((int)jobs.size(), [&](int i) {
+        Model &m = *models.at(jobs[i].model);
+        ok[i] = m.nfaces()>0 && render_job(jobs[i], i, m);
+    });
+    clock::time_point done = clock::now();
+
+    int nfailed = 0;
+    for (size_t i=0; i<jobs.size(); i++) nfailed += !ok[i];
+    double load_s   = std::chrono::duration<double>(loaded-start).count();
+    double render_s = std::chrono::duration<double>(done-loaded).count();
+    std::cerr << jobs.size() << " jobs (" << nfailed << " failed), " << models.size() << " models loaded in " << load_s << "s, "
+              << "rendered in " << render_s << "s on " << pool.size() << " threads: " << (render_s>0 ? jobs.size()/render_s : 0) << " frames/s\n";
+    return nfailed;
+}
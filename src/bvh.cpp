@@ -0,0 +1,349 @@
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include "bvh.h"
+#include "model.h"
+#include "raster.h"
+#include "meshcache.h"
+#include "mappedfile.h"
+
+const int SAH_BINS = 16;
+const int MAX_LEAF = 8;       // bigger nodes are always split, smaller ones only when the SAH says so
+const int SUBTREES_PER_THREAD = 4;
+
+struct Box {
+    Vec3f lo, hi;
+    Box() : lo(1e30f, 1e30f, 1e30f), hi(-1e30f, -1e30f, -1e30f) {}
+    void grow(const Vec3f &p) {
+        for (int i=0; i<3; i++) {
+            lo[i] = std::min(lo[i], p[i]);
+            hi[i] = std::max(hi[i], p[i]);
+        }
+    }
+    void grow(const Box &b) {
+        if (b.lo.x>b.hi.x) return; // empty
+        grow(b.lo);
+        grow(b.hi);
+    }
+    float area() const {
+        Vec3f d = hi-lo;
+        return d.x<0 ? 0.f : 2.f*(d.x*d.y + d.y*d.z + d.z*d.x);
+    }
+};
+
+struct Builder {
+    std::vector<Box> boxes; // per face of the model
+    std::vector<Vec3f> centroids;
+    std::vector<int> &faces;
+};
+
+// a subtree below the serial top of the tree, built into its own array
+struct Subtree {
+    int node;
+    int start;
+    int count;
+    std::vector<BVH::Node> nodes;
+};
+
+// SAH split of faces[start, start+count), returns the first face of the right half or 0 for a leaf
+static int split(Builder &b, int start, int count, const Box &bounds) {
+    if (count<=2) return 0;
+    Box cbounds;
+    for (int i=start; i<start+count; i++) cbounds.grow(b.centroids[b.faces[i]]);
+    Vec3f extent = cbounds.hi-cbounds.lo;
+    int axis = extent.x>extent.y ? (extent.x>extent.z ? 0 : 2) : (extent.y>extent.z ? 1 : 2);
+    if (!(extent[axis]>0)) return 0; // all the centroids at the same place, nothing to separate
+    float lo = cbounds.lo[axis], scale = SAH_BINS/extent[axis];
+    auto bin = [&](int face) { return std::min(SAH_BINS-1, (int)((b.centroids[face][axis]-lo)*scale)); };
+
+    Box binbox[SAH_BINS];
+    int bincount[SAH_BINS] = {0};
+    for (int i=start; i<start+count; i++) {
+        int k = bin(b.faces[i]);
+        binbox[k].grow(b.boxes[b.faces[i]]);
+        bincount[k]++;
+    }
+    float rightcost[SAH_BINS]; // area*count of the bins k.. together
+    Box acc;
+    for (int k=SAH_BINS-1, n=0; k>0; k--) {
+        acc.grow(binbox[k]);
+        n += bincount[k];
+        rightcost[k] = acc.area()*n;
+    }
+    float best = 1e30f;
+    int bestbin = -1;
+    acc = Box();
+    for (int k=0, n=0; k<SAH_BINS-1; k++) {
+        acc.grow(binbox[k]);
+        n += bincount[k];
+        if (0==n || n==count) continue;
+        float cost = acc.area()*n + rightcost[k+1];
+        if (cost<best) {
+            best = cost;
+            bestbin = k;
+        }
+    }
+    // splitting costs a traversal step plus the area-weighted tests of the halves, in units of a triangle test
+    if (bestbin<0 || (count<=MAX_LEAF && !(best<bounds.area()*(count-1)))) return 0;
+    return (int)(std::partition(b.faces.begin()+start, b.faces.begin()+start+count, [&](int face) { return bin(face)<=bestbin; }) - b.faces.begin());
+}
+
+// fills nodes[index] for faces[start, start+count) and builds below it, the ranges of at most
+// threshold faces are left to subtrees when subtrees is given
+static void build_node(Builder &b, std::vector<BVH::Node> &nodes, int index, int start, int count, int threshold, std::vector<Subtree> *subtrees) {
+    Box bounds;
+    for (int i=start; i<start+count; i++) bounds.grow(b.boxes[b.faces[i]]);
+    BVH::Node &n = nodes[index];
+    for (int i=0; i<3; i++) {
+        n.bmin[i] = bounds.lo[i];
+        n.bmax[i] = bounds.hi[i];
+    }
+    n.start = start;
+    n.count = count;
+    n.child = 0;
+    if (subtrees && count<=threshold) {
+        subtrees->push_back(Subtree{index, start, count, std::vector<BVH::Node>()});
+        return;
+    }
+    int mid = split(b, start, count, bounds);
+    if (!mid) return;
+    int child = (int)nodes.size();
+    nodes[index].child = child; // n is dangling after the resize
+    nodes.resize(child+2);
+    build_node(b, nodes, child,   start, mid-start,       threshold, subtrees);
+    build_node(b, nodes, child+1, mid,   start+count-mid, threshold, subtrees);
+}
+
+static uint64_t geometry_hash(Model &model) {
+    uint64_t h = 0;
+    for (int i=0; i<3; i++) {
+        Span<const float> v = model.verts(i);
+        h = h*31 ^ hash_bytes((const char *)v.data(), v.size()*sizeof(float));
+    }
+    Span<const int> idx = model.vert_indices();
+    return h*31 ^ hash_bytes((const char *)idx.data(), idx.size()*sizeof(int));
+}
+
+BVH::BVH() : nodes_(), faces_(), tris_() {
+}
+
+void BVH::build(Model &model, ThreadPool &pool) {
+    int nfaces = model.nfaces();
+    nodes_.clear();
+    faces_.resize(nfaces);
+    tris_.resize(nfaces*3);
+    if (!nfaces) return;
+
+    Builder b{std::vector<Box>(nfaces), std::vector<Vec3f>(nfaces), faces_};
+    int nchunks = std::min(nfaces, pool.size()*SUBTREES_PER_THREAD);
+    pool.parallel_for(nchunks, [&](int c) {
+        for (int f=(long)c*nfaces/nchunks; f<(long)(c+1)*nfaces/nchunks; f++) {
+            Box box;
+            for (int j=0; j<3; j++) box.grow(model.vert(f, j));
+            b.boxes[f] = box;
+            b.centroids[f] = (box.lo+box.hi)*.5f;
+            faces_[f] = f;
+        }
+    });
+
+    std::vector<Subtree> subtrees;
+    nodes_.resize(1);
+    build_node(b, nodes_, 0, 0, nfaces, std::max(MAX_LEAF, nfaces/(pool.size()*SUBTREES_PER_THREAD)), &subtrees);
+    pool.parallel_for((int)subtrees.size(), [&](int i) {
+        Subtree &s = subtrees[i];
+        s.nodes.resize(1);
+        build_node(b, s.nodes, 0, s.start, s.count, 0, NULL);
+    });
+    for (size_t i=0; i<subtrees.size(); i++) { // the root replaces the placeholder, the rest goes at the end
+        std::vector<Node> &sub = subtrees[i].nodes;
+        int base = (int)nodes_.size()-1;
+        for (size_t j=0; j<sub.size(); j++)
+            if (sub[j].child) sub[j].child += base;
+        nodes_[subtrees[i].node] = sub[0];
+        nodes_.insert(nodes_.end(), sub.begin()+1, sub.end());
+    }
+
+    pool.parallel_for(nchunks, [&](int c) {
+        for (int i=(long)c*nfaces/nchunks; i<(long)(c+1)*nfaces/nchunks; i++)
+            for (int j=0; j<3; j++) tris_[i*3+j] = model.vert(faces_[i], j);
+    });
+}
+
+struct BVHCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t hash; // of the vertex positions and indices of the model
+    int32_t nnodes;
+    int32_t nfaces;
+};
+
+static const char bvh_cache_magic[8] = {'T','R','B','V','H','\0','\0','\0'};
+const uint32_t BVH_CACHE_VERSION = 1;
+
+bool BVH::save(const char *filename, Model &model) const {
+    BVHCacheHeader header;
+    memset((void *)&header, 0, sizeof(header));
+    memcpy(header.magic, bvh_cache_magic, sizeof(header.magic));
+    header.version = BVH_CACHE_VERSION;
+    header.header_size = sizeof(header);
+    header.hash = geometry_hash(model);
+    header.nnodes = (int32_t)nodes_.size();
+    header.nfaces = (int32_t)faces_.size();
+
+    std::string tmpname = std::string(filename) + ".tmp"; // written aside and renamed, like the mesh cache
+    std::ofstream out(tmpname.c_str(), std::ios::binary);
+    if (!out.is_open()) return false;
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)nodes_.data(), nodes_.size()*sizeof(Node));
+    out.write((const char *)faces_.data(), faces_.size()*sizeof(int));
+    out.write((const char *)tris_.data(),  tris_.size()*sizeof(Vec3f));
+    out.close();
+    if (!out.good() || 0!=std::rename(tmpname.c_str(), filename)) {
+        std::remove(tmpname.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool BVH::load(const char *filename, Model &model) {
+    MappedFile file;
+    if (!file.open(filename) || file.size()<sizeof(BVHCacheHeader)) return false;
+    BVHCacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, bvh_cache_magic, sizeof(header.magic)) || header.version!=BVH_CACHE_VERSION
+        || header.header_size!=sizeof(header) || header.nfaces!=model.nfaces() || header.nnodes<0) return false;
+    size_t nodes_size = header.nnodes*sizeof(Node), faces_size = header.nfaces*sizeof(int), tris_size = header.nfaces*3*sizeof(Vec3f);
+    if (sizeof(header)+nodes_size+faces_size+tris_size!=file.size() || header.hash!=geometry_hash(model)) return false;
+    const char *p = file.data()+sizeof(header);
+    nodes_.resize(header.nnodes);
+    faces_.resize(header.nfaces);
+    tris_ .resize(header.nfaces*3);
+    memcpy((void *)nodes_.data(), p, nodes_size);
+    memcpy((void *)faces_.data(), p+nodes_size, faces_size);
+    memcpy((void *)tris_ .data(), p+nodes_size+faces_size, tris_size);
+    // the children come after their parent (no cycles) and every range and face is within the counts,
+    // the traversals trust them
+    bool valid = true;
+    for (int i=0; valid && i<header.nnodes; i++) {
+        const Node &n = nodes_[i];
+        valid = (0==n.child || (n.child>i && n.child+1<header.nnodes)) && n.start>=0 && n.count>=0 && n.start<=header.nfaces-n.count;
+    }
+    for (int i=0; valid && i<header.nfaces; i++) valid = faces_[i]>=0 && faces_[i]<header.nfaces;
+    if (!valid) {
+        nodes_.clear();
+        faces_.clear();
+        tris_.clear();
+    }
+    return valid;
+}
+
+void BVH::cull(const Matrix &m, Vec2i imagesize, std::vector<int> &out) const {
+    if (empty()) return;
+    // inside is p*(x,y,z,1)>=0 for the planes x>=0, x<=width*w, y>=0, y<=height*w widened by SNAP_SLACK,
+    // and w>=NEAR_W
+    const int NPLANES = 5;
+    Vec4f planes[NPLANES] = {m[0]+m[3]*SNAP_SLACK, m[3]*(imagesize.x+SNAP_SLACK)-m[0], m[1]+m[3]*SNAP_SLACK, m[3]*(imagesize.y+SNAP_SLACK)-m[1], m[3]};
+    planes[4][3] -= NEAR_W;
+    std::vector<unsigned char> visible(faces_.size(), 0); // by face of the model
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const Node &n = nodes_[stack.back()];
+        stack.pop_back();
+        bool outside = false, inside = true;
+        for (int i=0; !outside && i<NPLANES; i++) {
+            const Vec4f &p = planes[i];
+            float far = p[3], near = p[3]; // the corners the farthest inside and the farthest outside
+            for (int k=0; k<3; k++) {
+                far  += p[k]*(p[k]>0 ? n.bmax[k] : n.bmin[k]);
+                near += p[k]*(p[k]>0 ? n.bmin[k] : n.bmax[k]);
+            }
+            outside = far<0;
+            inside = inside && near>=0;
+        }
+        if (outside) continue;
+        if (inside || !n.child) {
+            for (int i=n.start; i<n.start+n.count; i++) visible[faces_[i]] = 1;
+            continue;
+        }
+        stack.push_back(n.child+1);
+        stack.push_back(n.child);
+    }
+    size_t n = out.size(); // back to the order of the model, without a branch per face
+    out.resize(n+visible.size());
+    for (size_t i=0; i<visible.size(); i++) {
+        out[n] = (int)i;
+        n += visible[i];
+    }
+    out.resize(n);
+}
+
+// entry distance of the ray into the node, or a negative value when it misses it within (tmin, tmax)
+static float slab(const BVH::Node &n, const Vec3f &orig, const Vec3f &invdir, float tmin, float tmax) {
+    for (int k=0; k<3; k++) {
+        float t0 = (n.bmin[k]-orig[k])*invdir[k], t1 = (n.bmax[k]-orig[k])*invdir[k];
+        if (t0>t1) std::swap(t0, t1);
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+    }
+    return tmin<=tmax ? tmin : -1.f;
+}
+
+bool BVH::intersect(Vec3f orig, Vec3f dir, Hit &hit, float tmin, float tmax) const {
+    if (empty()) return false;
+    Vec3f invdir(1.f/dir.x, 1.f/dir.y, 1.f/dir.z);
+    hit.face = -1;
+    hit.t = tmax;
+    if (slab(nodes_[0], orig, invdir, tmin, hit.t)<0) return false;
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const Node &n = nodes_[stack.back()];
+        stack.pop_back();
+        if (!n.child) {
+            for (int i=n.start; i<n.start+n.count; i++) { // Moller-Trumbore
+                const Vec3f *v = &tris_[i*3];
+                Vec3f e1 = v[1]-v[0], e2 = v[2]-v[0];
+                Vec3f p = cross(dir, e2);
+                float det = e1*p;
+                if (std::abs(det)<1e-12f) continue;
+                float inv = 1.f/det;
+                Vec3f s = orig-v[0];
+                float u = (s*p)*inv;
+                if (u<0 || u>1) continue;
+                Vec3f q = cross(s, e1);
+                float w = (dir*q)*inv;
+                if (w<0 || u+w>1) continue;
+                float t = (e2*q)*inv;
+                if (t<=tmin || t>=hit.t) continue;
+                hit.face = faces_[i];
+                hit.t = t;
+                hit.bar = Vec3f(1.f-u-w, u, w);
+            }
+            continue;
+        }
+        float t0 = slab(nodes_[n.child],   orig, invdir, tmin, hit.t);
+        float t1 = slab(nodes_[n.child+1], orig, invdir, tmin, hit.t);
+        int first = n.child, second = n.child+1; // the nearer child goes on top of the stack
+        if (t1>=0 && (t0<0 || t1<t0)) {
+            std::swap(first, second);
+            std::swap(t0, t1);
+        }
+        if (t1>=0) stack.push_back(second);
+        if (t0>=0) stack.push_back(first);
+    }
+    return hit.face>=0;
+}
+
+bool BVH::pick(const Matrix &m, Vec2f pixel, Hit &hit) const {
+    // the points seen at pixel are inv*(x*w, y*w, z, w) = w*a + z*b, the one with last coordinate 1 is
+    // eye + w*dir, w being the homogeneous coordinate the pipeline divides by
+    Matrix inv = m.invert();
+    Vec4f a = inv*embed<4>(Vec3f(pixel.x, pixel.y, 0)), b = inv.col(2);
+    if (std::abs(b[3])<1e-12f) return false; // orthographic, no eye to cast from
+    Vec3f eye = proj<3>(b)/b[3];
+    Vec3f dir = proj<3>(a) - proj<3>(b)*(a[3]/b[3]);
+    return intersect(eye, dir, hit, NEAR_W);
+}
@@ -0,0 +1,69 @@
+#include <limits>
+#include <algorithm>
+#include "depthbuffer.h"
+
+DepthBuffer::DepthBuffer(int w, int h, bool reversed) : width_(w), height_(h), reversed_(reversed), nblocks_x_(0), nblocks_y_(0), data_(), near_(), far_(), dirty_() {
+    nblocks_x_ = (w+BLOCK_SIZE-1)/BLOCK_SIZE;
+    nblocks_y_ = (h+BLOCK_SIZE-1)/BLOCK_SIZE;
+    data_.resize(w*h);
+    near_.resize(nblocks_x_*nblocks_y_);
+    far_ .resize(nblocks_x_*nblocks_y_);
+    dirty_.resize(nblocks_x_*nblocks_y_);
+    clear();
+}
+
+float DepthBuffer::farthest() const {
+    return reversed_ ? -std::numeric_limits<float>::max() : std::numeric_limits<float>::max();
+}
+
+void DepthBuffer::clear() {
+    std::fill(data_.begin(), data_.end(), farthest());
+    std::fill(near_.begin(), near_.end(), farthest());
+    std::fill(far_ .begin(), far_ .end(), farthest());
+    std::fill(dirty_.begin(), dirty_.end(), 0);
+}
+
+void DepthBuffer::update_block(int b) {
+    int x0 = (b%nblocks_x_)*BLOCK_SIZE, x1 = std::min(x0+BLOCK_SIZE, width_);
+    int y0 = (b/nblocks_x_)*BLOCK_SIZE, y1 = std::min(y0+BLOCK_SIZE, height_);
+    float lo = data_[x0+y0*width_], hi = lo;
+    for (int y=y0; y<y1; y++) {
+        const float *r = row(y);
+        for (int x=x0; x<x1; x++) {
+            lo = std::min(lo, r[x]);
+            hi = std::max(hi, r[x]);
+        }
+    }
+    near_[b] = reversed_ ? hi : lo;
+    far_ [b] = reversed_ ? lo : hi;
+    dirty_[b] = 0;
+}
+
+float DepthBuffer::block_near(int bx, int by) {
+    int b = bx+by*nblocks_x_;
+    if (dirty_[b]) update_block(b);
+    return near_[b];
+}
+
+float DepthBuffer::block_far(int bx, int by) {
+    int b = bx+by*nblocks_x_;
+    if (dirty_[b]) update_block(b);
+    return far_[b];
+}
+
+TGAImage DepthBuffer::to_image(float znear, float zfar) const {
+    TGAImage img(width_, height_, TGAImage::GRAYSCALE);
+    for (int y=0; y<height_; y++) {
+        const float *r = row(y);
+        for (int x=0; x<width_; x++) {
+            float t = (zfar-r[x])/(zfar-znear);
+            img.set(x, y, TGAColor((unsigned char)(std::max(0.f, std::min(1.f, t))*255.f+.5f)));
+        }
+    }
+    return img;
+}
+
+TGAImage DepthBuffer::to_image() const {
+    return reversed_ ? to_image(1.f, 0.f) : to_image(0.f, 1.f);
+}
+
@@ -0,0 +1,64 @@
+#include <new>
+#include "framebufferpool.h"
+
+unsigned char *aligned_pixels(size_t nbytes) {
+    return new (std::align_val_t(FRAMEBUFFER_ALIGNMENT)) unsigned char[nbytes ? nbytes : 1];
+}
+
+void free_aligned_pixels(unsigned char *p) {
+    ::operator delete[](p, std::align_val_t(FRAMEBUFFER_ALIGNMENT));
+}
+
+FramebufferPool::FramebufferPool() : mutex_(), free_(), used_() {
+}
+
+FramebufferPool::~FramebufferPool() {
+    trim();
+}
+
+FramebufferPool &FramebufferPool::shared() {
+    static FramebufferPool pool;
+    return pool;
+}
+
+unsigned char *FramebufferPool::acquire(size_t nbytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int best = -1;
+    for (int i=0; i<(int)free_.size(); i++) {
+        if (free_[i].capacity>=nbytes && (best<0 || free_[i].capacity<free_[best].capacity)) best = i;
+    }
+    Buffer buf;
+    if (best<0) {
+        buf.data = aligned_pixels(nbytes);
+        buf.capacity = nbytes;
+    } else {
+        buf = free_[best];
+        free_[best] = free_.back();
+        free_.pop_back();
+    }
+    used_[buf.data] = buf.capacity;
+    return buf.data;
+}
+
+void FramebufferPool::release(unsigned char *p) {
+    if (!p) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<unsigned char *, size_t>::iterator it = used_.find(p);
+    if (it==used_.end()) return; // not ours
+    Buffer buf = {p, it->second};
+    used_.erase(it);
+    free_.push_back(buf);
+}
+
+void FramebufferPool::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i=0; i<free_.size(); i++) free_aligned_pixels(free_[i].data);
+    free_.clear();
+}
+
+size_t FramebufferPool::cached_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t total = 0;
+    for (size_t i=0; i<free_.size(); i++) total += free_[i].capacity;
+    return total;
+}
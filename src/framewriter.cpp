@@ -0,0 +1,199 @@
+#include <iostream>
+#include <cstring>
+#include <csignal>
+#include <cctype>
+#include "framewriter.h"
+
+FramePattern::FramePattern() : prefix_(), suffix_(), width_(0), numbered_(false) {
+}
+
+bool FramePattern::parse(const std::string &pattern) {
+    const int MAX_WIDTH = 20; // digits of the padding, the number itself never needs more
+    prefix_.clear();
+    suffix_.clear();
+    width_ = 0;
+    numbered_ = false;
+    for (size_t i=0; i<pattern.size(); i++) {
+        std::string &text = numbered_ ? suffix_ : prefix_;
+        if ('%'!=pattern[i]) {
+            text += pattern[i];
+        } else if (i+1<pattern.size() && '%'==pattern[i+1]) {
+            text += '%';
+            i++;
+        } else {
+            if (numbered_) return false; // a second conversion
+            size_t j = i+1;
+            if (j<pattern.size() && '0'==pattern[j]) {
+                for (j++; j<pattern.size() && isdigit((unsigned char)pattern[j]); j++) {
+                    width_ = width_*10 + (pattern[j]-'0');
+                    if (width_>MAX_WIDTH) return false;
+                }
+            }
+            if (j>=pattern.size() || 'd'!=pattern[j]) return false;
+            numbered_ = true;
+            i = j;
+        }
+    }
+    return true;
+}
+
+std::string FramePattern::name(int index) const {
+    if (!numbered_) return prefix_;
+    char number[32];
+    snprintf(number, sizeof(number), "%0*d", width_, index);
+    return prefix_ + number + suffix_;
+}
+
+FrameWriter::FrameWriter(const char *target, Format format, int width, int height, int bpp, int fps) :
+    target_(target), names_(), format_(format), width_(width), height_(height), bpp_(bpp), fps_(fps), out_(NULL), open_(false), buffers_(), back_(0),
+    nframes_(0), scratch_(), thread_(), mutex_(), cv_(), pending_(false), quit_(false), failed_(false) {
+    for (int i=0; i<2; i++)
+        buffers_[i] = TGAImage(width, height, bpp, FramebufferPool::shared());
+    if (TGA==format_ && !names_.parse(target_)) {
+        std::cerr << "bad frame file name " << target << ", it takes at most one %d or %0Nd\n";
+        return;
+    }
+    if (TGA!=format_) {
+        if (target_=="-") {
+            out_ = stdout;
+        } else {
+            out_ = fopen(target, "wb"); // blocks on a FIFO until the reader shows up
+        }
+        if (!out_) {
+            std::cerr << "can't open " << target << "\n";
+            return;
+        }
+        signal(SIGPIPE, SIG_IGN); // a reader going away must fail the write, not kill the renderer
+        if (Y4M==format_) {
+            fprintf(out_, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 %s\n", width_, height_, fps_, 1==bpp_ ? "Cmono" : "C444");
+        }
+    }
+    open_ = true;
+    thread_ = std::thread(&FrameWriter::encoder, this);
+}
+
+FrameWriter::~FrameWriter() {
+    close();
+}
+
+FrameWriter::Format FrameWriter::format_from_target(const char *target) {
+    if (!strcmp(target, "-")) return Y4M;
+    const char *ext = strrchr(target, '.');
+    if (!ext) return TGA;
+    if (!strcmp(ext, ".y4m")) return Y4M;
+    if (!strcmp(ext, ".ppm") || !strcmp(ext, ".pgm")) return PPM;
+    if (!strcmp(ext, ".raw") || !strcmp(ext, ".rgb")) return RAW;
+    return TGA;
+}
+
+bool FrameWriter::present() {
+    if (!open_) return false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !pending_; });
+        if (TGA==format_ && !names_.numbered() && nframes_>0 && !failed_) {
+            std::cerr << "the frame file name " << target_ << " has no frame number, only one frame is written\n";
+            failed_ = true;
+        }
+        if (failed_) return false;
+        pending_ = true;
+        back_ = 1-back_;
+    }
+    cv_.notify_all();
+    buffers_[back_].clear(); // the encoder is done with it
+    return true;
+}
+
+bool FrameWriter::close() {
+    if (!open_) return false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !pending_; });
+        quit_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    if (out_) {
+        if (fflush(out_)) failed_ = true;
+        if (out_!=stdout) fclose(out_);
+        out_ = NULL;
+    }
+    open_ = false;
+    return !failed_;
+}
+
+void FrameWriter::encoder() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() { return quit_ || pending_; });
+        if (!pending_) return;
+        TGAImage &img = buffers_[1-back_];
+        int index = nframes_;
+        lock.unlock();
+        bool ok = write_frame(img, index);
+        lock.lock();
+        failed_ = failed_ || !ok;
+        nframes_++;
+        pending_ = false;
+        cv_.notify_all();
+    }
+}
+
+bool FrameWriter::write_frame(TGAImage &img, int index) {
+    if (TGA==format_) {
+        return img.write_tga_file(names_.name(index).c_str(), true, true);
+    }
+    return write_stream(img);
+}
+
+// rows are emitted last to first, that is the vertical flip
+bool FrameWriter::write_stream(TGAImage &img) {
+    const unsigned char *data = img.buffer();
+    int w = width_, h = height_, bpp = bpp_;
+    unsigned long linebytes = (unsigned long)w*bpp;
+    if (RAW==format_) {
+        for (int y=h-1; y>=0; y--)
+            if (fwrite(data+y*linebytes, 1, linebytes, out_)!=linebytes) return false;
+        return true;
+    }
+    if (PPM==format_) {
+        int nc = 1==bpp ? 1 : 3;
+        fprintf(out_, "P%d\n%d %d\n255\n", 1==bpp ? 5 : 6, w, h);
+        scratch_.resize((unsigned long)w*nc);
+        for (int y=h-1; y>=0; y--) {
+            const unsigned char *p = data+y*linebytes;
+            if (1==bpp) {
+                memcpy(scratch_.data(), p, w);
+            } else {
+                for (int x=0; x<w; x++, p+=bpp) { // bgr to rgb
+                    scratch_[x*3+0] = p[2];
+                    scratch_[x*3+1] = p[1];
+                    scratch_[x*3+2] = p[0];
+                }
+            }
+            if (fwrite(scratch_.data(), 1, scratch_.size(), out_)!=scratch_.size()) return false;
+        }
+        return true;
+    }
+    // Y4M, planar
+    int nplanes = 1==bpp ? 1 : 3;
+    unsigned long plane = (unsigned long)w*h;
+    scratch_.resize(plane*nplanes);
+    unsigned char *Y = scratch_.data(), *U = Y+plane, *V = U+plane;
+    for (int y=0; y<h; y++) {
+        const unsigned char *p = data+(h-1-y)*linebytes;
+        unsigned long o = (unsigned long)y*w;
+        if (1==bpp) {
+            memcpy(Y+o, p, w);
+            continue;
+        }
+        for (int x=0; x<w; x++, p+=bpp) {
+            int b = p[0], g = p[1], r = p[2];
+            Y[o+x] = (unsigned char)((( 66*r + 129*g +  25*b + 128)>>8) +  16);
+            U[o+x] = (unsigned char)(((-38*r -  74*g + 112*b + 128)>>8) + 128);
+            V[o+x] = (unsigned char)(((112*r -  94*g -  18*b + 128)>>8) + 128);
+        }
+    }
+    if (fputs("FRAME\n", out_)<0) return false;
+    return fwrite(scratch_.data(), 1, scratch_.size(), out_)==scratch_.size();
+}
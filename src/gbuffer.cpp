@@ -0,0 +1,24 @@
+#include "gbuffer.h"
+
+GBuffer::GBuffer(int w, int h) : width_(w), height_(h), data_() {
+    data_.resize(w*h);
+    clear();
+}
+
+void GBuffer::clear() {
+    std::fill(data_.begin(), data_.end(), Sample{-1, Vec3f(0, 0, 0)});
+}
+
+void gbuffer_triangle(const Vec4f *pts, int iface, GBuffer &gbuffer, DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax) {
+    auto store = [&](int x, int y, const Vec3f &bar) {
+        gbuffer.set(x, y, iface, bar);
+        return true;
+    };
+    draw_triangle(pts, Vec2i(gbuffer.get_width(), gbuffer.get_height()), zbuffer, clipmin, clipmax, store);
+}
+
+void gbuffer_triangle(const Vec4f *pts, int iface, GBuffer &gbuffer, DepthBuffer &zbuffer) {
+    STATS_SCOPE();
+    STATS_ADD(triangles_submitted, 1);
+    gbuffer_triangle(pts, iface, gbuffer, zbuffer, Vec2i(0, 0), Vec2i(gbuffer.get_width(), gbuffer.get_height()));
+}
@@ -5,3 +5,67 @@ template <> template <> vec<3,float>::vec(const vec<3,int> &v)   : x(v.x),y(v.y)
 template <> template <> vec<2,int>  ::vec(const vec<2,float> &v) : x(int(v.x+.5f)),y(int(v.y+.5f)) {}
 template <> template <> vec<2,float>::vec(const vec<2,int> &v)   : x(v.x),y(v.y) {}
 
+
+void transform_points(const Matrix &m, const float *x, const float *y, const float *z, int n, Vec4f *out) {
+    int i = 0;
+#if defined(__AVX__)
+    __m256 r[4][4];
+    for (int j=0; j<4; j++)
+        for (int k=0; k<4; k++) r[j][k] = _mm256_set1_ps(m[j][k]);
+    for (; i+8<=n; i+=8) {
+        __m256 X = _mm256_loadu_ps(x+i), Y = _mm256_loadu_ps(y+i), Z = _mm256_loadu_ps(z+i), o[4];
+        for (int j=0; j<4; j++)
+            o[j] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(r[j][3], _mm256_mul_ps(r[j][2], Z)), _mm256_mul_ps(r[j][1], Y)), _mm256_mul_ps(r[j][0], X));
+        // back to one point per 128-bit lane: points i, i+4 | i+1, i+5 | i+2, i+6 | i+3, i+7
+        __m256 t0 = _mm256_unpacklo_ps(o[0], o[1]), t1 = _mm256_unpackhi_ps(o[0], o[1]);
+        __m256 t2 = _mm256_unpacklo_ps(o[2], o[3]), t3 = _mm256_unpackhi_ps(o[2], o[3]);
+        __m256 p0 = _mm256_shuffle_ps(t0, t2, 0x44), p1 = _mm256_shuffle_ps(t0, t2, 0xee);
+        __m256 p2 = _mm256_shuffle_ps(t1, t3, 0x44), p3 = _mm256_shuffle_ps(t1, t3, 0xee);
+        float *dst = &out[i][0];
+        _mm256_storeu_ps(dst,    _mm256_permute2f128_ps(p0, p1, 0x20));
+        _mm256_storeu_ps(dst+8,  _mm256_permute2f128_ps(p2, p3, 0x20));
+        _mm256_storeu_ps(dst+16, _mm256_permute2f128_ps(p0, p1, 0x31));
+        _mm256_storeu_ps(dst+24, _mm256_permute2f128_ps(p2, p3, 0x31));
+    }
+#elif defined(__SSE2__)
+    __m128 r[4][4];
+    for (int j=0; j<4; j++)
+        for (int k=0; k<4; k++) r[j][k] = _mm_set1_ps(m[j][k]);
+    for (; i+4<=n; i+=4) {
+        __m128 X = _mm_loadu_ps(x+i), Y = _mm_loadu_ps(y+i), Z = _mm_loadu_ps(z+i), o[4];
+        for (int j=0; j<4; j++)
+            o[j] = _mm_add_ps(_mm_add_ps(_mm_add_ps(r[j][3], _mm_mul_ps(r[j][2], Z)), _mm_mul_ps(r[j][1], Y)), _mm_mul_ps(r[j][0], X));
+        _MM_TRANSPOSE4_PS(o[0], o[1], o[2], o[3]);
+        for (int j=0; j<4; j++) out[i+j] = Vec4f(o[j]);
+    }
+#endif
+    // the same sums as Matrix*Vec4f with a last coordinate of 1
+    for (; i<n; i++)
+        for (int j=0; j<4; j++) out[i][j] = m[j][3] + m[j][2]*z[i] + m[j][1]*y[i] + m[j][0]*x[i];
+}
+
+void transform_directions(const Matrix &m, const float *x, const float *y, const float *z, int n, float *ox, float *oy, float *oz) {
+    float *o[3] = {ox, oy, oz};
+    int i = 0;
+#if defined(__AVX__)
+    __m256 r[3][3];
+    for (int j=0; j<3; j++)
+        for (int k=0; k<3; k++) r[j][k] = _mm256_set1_ps(m[j][k]);
+    for (; i+8<=n; i+=8) {
+        __m256 X = _mm256_loadu_ps(x+i), Y = _mm256_loadu_ps(y+i), Z = _mm256_loadu_ps(z+i);
+        for (int j=0; j<3; j++)
+            _mm256_storeu_ps(o[j]+i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r[j][2], Z), _mm256_mul_ps(r[j][1], Y)), _mm256_mul_ps(r[j][0], X)));
+    }
+#elif defined(__SSE2__)
+    __m128 r[3][3];
+    for (int j=0; j<3; j++)
+        for (int k=0; k<3; k++) r[j][k] = _mm_set1_ps(m[j][k]);
+    for (; i+4<=n; i+=4) {
+        __m128 X = _mm_loadu_ps(x+i), Y = _mm_loadu_ps(y+i), Z = _mm_loadu_ps(z+i);
+        for (int j=0; j<3; j++)
+            _mm_storeu_ps(o[j]+i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[j][2], Z), _mm_mul_ps(r[j][1], Y)), _mm_mul_ps(r[j][0], X)));
+    }
+#endif
+    for (; i<n; i++)
+        for (int j=0; j<3; j++) o[j][i] = m[j][2]*z[i] + m[j][1]*y[i] + m[j][0]*x[i];
+}
@@ -1,117 +1,278 @@
 #include <vector>
+#include <string>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <memory>
+#include <algorithm>
 
 #include "tgaimage.h"
 #include "model.h"
 #include "geometry.h"
 #include "our_gl.h"
+#include "gbuffer.h"
+#include "msaa.h"
+#include "bvh.h"
+#include "instancing.h"
+#include "shaders.h"
+#include "framewriter.h"
+#include "batch.h"
+#include "stats.h"
 
-Model *model     = NULL;
 const int width  = 800;
 const int height = 800;
 
-Vec3f light_dir(1, 1, 1);
 Vec3f       eye(0, 0, 3);
 Vec3f    center(0, 0, 0);
 Vec3f        up(0, 1, 0);
 
-struct GouraudShader : public IShader {
-    Vec3f varying_intensity; 
+static DrawContext camera(const Vec3f &eye) {
+    return DrawContext(lookat_matrix(eye, center, up), projection_matrix(-1.f/(eye-center).norm()), viewport_matrix(width/8, height/8, width*3/4, height*3/4));
+}
 
-    virtual Vec4f vertex(int iface, int nthvert) {
-        Vec4f gl_Vertex = embed<4>(model->vert(iface, nthvert)); 
-        gl_Vertex = Viewport*Projection*ModelView*gl_Vertex;     
-        varying_intensity[nthvert] = std::max(0.f, model->normal(iface, nthvert)*light_dir); 
-        return gl_Vertex;
+// one frame of the model seen from eye, serial when pool is NULL; deferred shading when gbuffer is given,
+// the geometry pass is serial then and the pool (or the shared one) shades the rows; multisampled when msaa
+// is given, drawn serially and resolved into image by the pool; with a bvh, only the faces of the subtrees
+// in the view frustum are assembled and rasterized; lod_error is the error in pixels allowed for the level
+// of detail, 0 draws the model itself
+static void render(const Vec3f &eye, TGAImage &image, DepthBuffer &zbuffer, const std::vector<float> &intensity, ThreadPool *pool, GBuffer *gbuffer, MultisampleBuffer *msaa, const BVH *bvh, float lod_error) {
+    DrawContext ctx = camera(eye);
+    std::vector<Vec4f> verts; // the whole vertex stage, done once per frame
+    std::vector<int> faces;   // in draw order
+    {
+        STATS_TIMER(STAGE_VERTEX);
+        Matrix m = ctx.clip();
+        transform_vertices(*model, m, verts); // dense and vectorized, cheaper than sorting out the culled vertices
+        int level = lod_error>0 ? model->select_lod(m, lod_error) : 0;
+        if (bvh && 0==level) { // the bvh is built over the model, not its simplified levels
+            bvh->cull(m, Vec2i(image.get_width(), image.get_height()), faces);
+        } else {
+            faces.resize(model->lod_nfaces(level));
+            for (int i=0; i<(int)faces.size(); i++) faces[i] = model->lod_first_face(level)+i;
+        }
     }
 
-    virtual bool fragment(Vec3f bar, TGAColor &color) {
-        float intensity = varying_intensity*bar;   
-        color = TGAColor(255, 255, 255)*intensity; 
-        return false;                              
+    GouraudShader shader;
+    shader.uniform_model     = model;
+    shader.uniform_verts     = verts.data();
+    shader.uniform_intensity = intensity.data();
+    STATS_TIMER(STAGE_RASTER);
+    if (msaa) {
+        msaa->clear();
+        for (size_t k=0; k<faces.size(); k++) {
+            int i = faces[k];
+            Vec4f screen_coords[3];
+            for (int j=0; j<3; j++) {
+                screen_coords[j] = shader.vertex(i, j);
+            }
+            multisample_triangle(screen_coords, shader, *msaa);
+        }
+        resolve_multisample(*msaa, image, pool ? *pool : ThreadPool::shared());
+    } else if (gbuffer) {
+        gbuffer->clear();
+        for (size_t k=0; k<faces.size(); k++) {
+            int i = faces[k];
+            Vec4f screen_coords[3];
+            for (int j=0; j<3; j++) {
+                screen_coords[j] = verts[model->vert_index(i, j)];
+            }
+            gbuffer_triangle(screen_coords, i, *gbuffer, zbuffer);
+        }
+        resolve_gbuffer(shader, *gbuffer, image, pool ? *pool : ThreadPool::shared());
+    } else if (!pool) {
+        for (size_t k=0; k<faces.size(); k++) {
+            int i = faces[k];
+            Vec4f screen_coords[3];
+            for (int j=0; j<3; j++) {
+                screen_coords[j] = shader.vertex(i, j);
+            }
+            triangle(screen_coords, shader, image, zbuffer);
+        }
+    } else {
+        TiledRaster<GouraudShader> raster(image, zbuffer);
+        for (size_t k=0; k<faces.size(); k++) {
+            int i = faces[k];
+            Vec4f screen_coords[3];
+            for (int j=0; j<3; j++) {
+                screen_coords[j] = shader.vertex(i, j);
+            }
+            raster.add(screen_coords, shader);
+        }
+        raster.flush(*pool);
     }
-};
-
-struct CelShader : public IShader {
-    Vec3f varying_intensity; 
+}
 
-    virtual Vec4f vertex(int iface, int nthvert) {
-        Vec4f gl_Vertex = embed<4>(model->vert(iface, nthvert)); 
-        gl_Vertex = Viewport*ModelView*gl_Vertex;     
-        varying_intensity[nthvert] = std::max(0.f, model->normal(iface, nthvert)*light_dir); 
-        return gl_Vertex;
+// a crowd of n copies of the model on a square grid around center, every one turned its own way and lit
+// in its own object space; the grid is scaled down to about the size of a single model
+static void render_crowd(int n, const Vec3f &eye, TGAImage &image, DepthBuffer &zbuffer, ThreadPool *pool, float lod_error) {
+    int side = (int)std::ceil(std::sqrt((float)n));
+    float scale = 1.f/side;
+    std::vector<Matrix> transforms(n);
+    std::vector<float> intensity(n*model->nnormals());
+    for (int i=0; i<n; i++) {
+        float angle = 2*M_PI*i/n;
+        Matrix &t = transforms[i];
+        t = Matrix::identity();
+        t[0][0] =  scale*std::cos(angle); t[0][2] = scale*std::sin(angle);
+        t[2][0] = -scale*std::sin(angle); t[2][2] = scale*std::cos(angle);
+        t[1][1] = scale;
+        t[0][3] = center.x + (2*(i%side)+1-side)*scale;
+        t[1][3] = center.y;
+        t[2][3] = center.z + (2*(i/side)+1-side)*scale;
+        Vec3f light = object_direction(t, light_dir);
+        for (int k=0; k<model->nnormals(); k++) intensity[i*model->nnormals()+k] = std::max(0.f, model->normal(k)*light);
     }
+    GouraudShader shader;
+    shader.uniform_model = model;
+    draw_instanced(*model, camera(eye), transforms, shader, [&](int i, GouraudShader &s, const Vec4f *verts) {
+        s.uniform_verts     = verts;
+        s.uniform_intensity = &intensity[i*model->nnormals()];
+    }, image, zbuffer, pool, lod_error);
+}
 
-    virtual bool fragment(Vec3f bar, TGAColor &color) {
-        float intensity = varying_intensity*bar;
-        if (intensity>.85) intensity = 1;
-        else if (intensity>.50) intensity = .80;
-        else if (intensity>.25) intensity = .30;
-        else intensity = 0;
-        color = TGAColor(130, 100, 230)*intensity;
-        return false;
+int main(int argc, char** argv) {
+    const char *filename = "obj/african_head.obj";
+    const char *target = NULL; // output.tga and zbuffer.tga unless -o is given
+    const char *format = NULL;
+    const char *manifest = NULL;
+    const char *statsfile = NULL; // with TINYRENDERER_STATS only
+    bool heatmap = false;
+    bool deferred = false;
+    bool culling = false;
+    bool reorder = false;
+    int ninstances = 0; // a crowd of copies of the model with -i
+    int nsamples = 0;   // multisample anti-aliasing with -m
+    float lod_error = 0; // in pixels, no level of detail unless -l is given
+    int nthreads = -1; // serial rasterization unless -j is given, -j 0 uses every core
+    int nframes = 1;   // more than one frame is a turntable around the model
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "-j") && i+1<argc) {
+            nthreads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i+1<argc) {
+            target = argv[++i];
+        } else if (!strcmp(argv[i], "-f") && i+1<argc) {
+            format = argv[++i];
+        } else if (!strcmp(argv[i], "-b") && i+1<argc) {
+            manifest = argv[++i];
+        } else if (!strcmp(argv[i], "-s") && i+1<argc) {
+            statsfile = argv[++i];
+        } else if (!strcmp(argv[i], "-l") && i+1<argc) {
+            lod_error = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-m") && i+1<argc) {
+            nsamples = std::max(0, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "-i") && i+1<argc) {
+            ninstances = std::max(0, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "-x")) {
+            rasterization(RASTER_FIXED);
+        } else if (!strcmp(argv[i], "-r")) {
+            reorder = true;
+        } else if (!strcmp(argv[i], "-c")) {
+            culling = true;
+        } else if (!strcmp(argv[i], "-d")) {
+            deferred = true;
+        } else if (!strcmp(argv[i], "-H")) {
+            heatmap = true;
+        } else if (!strcmp(argv[i], "-n") && i+1<argc) {
+            nframes = std::max(1, atoi(argv[++i]));
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (ninstances && (deferred || culling)) std::cerr << "a crowd is drawn forward without the bvh, -d and -c are ignored\n";
+    if (nsamples && (ninstances || deferred)) std::cerr << "multisampling draws the model forward, -m is ignored with -i and -d\n";
+    if (nsamples>MultisampleBuffer::MAX_SAMPLES) std::cerr << "at most " << MultisampleBuffer::MAX_SAMPLES << " samples per pixel\n";
+#ifndef TINYRENDERER_STATS
+    if (statsfile || heatmap) std::cerr << "built without TINYRENDERER_STATS, -s and -H are ignored\n";
+#endif
+    if (manifest) { // batch mode, every core unless -j says otherwise
+        std::vector<BatchJob> jobs;
+        if (!read_manifest(manifest, jobs)) return 1;
+        std::unique_ptr<ThreadPool> pool(nthreads<0 ? NULL : new ThreadPool(nthreads));
+        int nfailed = run_batch(jobs, pool ? *pool : ThreadPool::shared());
+#ifdef TINYRENDERER_STATS
+        if (statsfile && !stats_write_json(statsfile)) std::cerr << "can't write " << statsfile << "\n";
+#endif
+        return nfailed ? 1 : 0;
     }
-};
-
 
-struct Shader : public IShader {
-    mat<2,3,float> varying_uv;  
-    mat<4,4,float> uniform_M;   
-    mat<4,4,float> uniform_MIT; 
+    model = new Model(filename, reorder);
+    light_dir.normalize();
 
-    virtual Vec4f vertex(int iface, int nthvert) {
-        varying_uv.set_col(nthvert, model->uv(iface, nthvert));
-        Vec4f gl_Vertex = embed<4>(model->vert(iface, nthvert)); 
-        return Viewport*Projection*ModelView*gl_Vertex; 
+    std::vector<float> intensity(model->nnormals());
+    for (int i=0; i<model->nnormals(); i++) {
+        intensity[i] = std::max(0.f, model->normal(i)*light_dir);
     }
-
-    virtual bool fragment(Vec3f bar, TGAColor &color) {
-        Vec2f uv = varying_uv*bar;
-        Vec3f n = proj<3>(uniform_MIT*embed<4>(model->normal(uv))).normalize();
-        Vec3f l = proj<3>(uniform_M  *embed<4>(light_dir        )).normalize();
-        Vec3f r = (n*(n*l*2.f) - l).normalize();   
-        float spec = pow(std::max(r.z, 0.0f), model->specular(uv));
-        float diff = std::max(0.f, n*l);
-        TGAColor c = model->diffuse(uv);
-        color = c;
-        for (int i=0; i<3; i++) color[i] = std::min<float>(5 + c[i]*(diff + .6*spec), 255);
-        return false;
+    std::unique_ptr<ThreadPool> pool(nthreads<0 ? NULL : new ThreadPool(nthreads));
+    DepthBuffer zbuffer(width, height);
+    std::unique_ptr<GBuffer> gbuffer(deferred ? new GBuffer(width, height) : NULL);
+    std::unique_ptr<MultisampleBuffer> msaa(nsamples && !deferred && !ninstances ? new MultisampleBuffer(width, height, nsamples) : NULL);
+    std::unique_ptr<BVH> bvh(culling ? new BVH() : NULL);
+    if (bvh) { // cached next to the model like the mesh
+        std::string cachefile = std::string(filename) + ".bvh";
+        if (!bvh->load(cachefile.c_str(), *model)) {
+            bvh->build(*model, pool ? *pool : ThreadPool::shared());
+            if (!bvh->save(cachefile.c_str(), *model)) std::cerr << "can't write the bvh cache " << cachefile << "\n";
+        }
     }
-};
-
-
 
-int main(int argc, char** argv) {
-    if (2==argc) {
-        model = new Model(argv[1]);
-    } else {
-        model = new Model("obj/african_head.obj");
+    if (!target) {
+        TGAImage image(width, height, TGAImage::RGB);
+#ifdef TINYRENDERER_STATS
+        if (heatmap) stats_heatmap_begin(width, height);
+#endif
+        if (ninstances) render_crowd(ninstances, eye, image, zbuffer, pool.get(), lod_error);
+        else render(eye, image, zbuffer, intensity, pool.get(), gbuffer.get(), msaa.get(), bvh.get(), lod_error);
+        {
+            STATS_TIMER(STAGE_OUTPUT);
+            image.write_tga_file("output.tga", true, true);
+            (msaa ? msaa->depth(0) : zbuffer).to_image().write_tga_file("zbuffer.tga", true, true); // the first sample
+        }
+#ifdef TINYRENDERER_STATS
+        if (heatmap) stats_heatmap_image().write_tga_file("overdraw.tga", true, true);
+        if (statsfile && !stats_write_json(statsfile)) std::cerr << "can't write " << statsfile << "\n";
+#endif
+        delete model;
+        return 0;
     }
 
-    lookat(eye, center, up);
-    viewport(width/8, height/8, width*3/4, height*3/4);
-    projection(-1.f/(eye-center).norm());
-    light_dir.normalize();
-
-    TGAImage image  (width, height, TGAImage::RGB);
-    TGAImage zbuffer(width, height, TGAImage::GRAYSCALE);
-
-    GouraudShader shader;
-    // shader.uniform_M   =  Projection*ModelView;
-    // shader.uniform_MIT = (Projection*ModelView).invert_transpose();
-    for (int i=0; i<model->nfaces(); i++) {
-        Vec4f screen_coords[3];
-        for (int j=0; j<3; j++) {
-            screen_coords[j] = shader.vertex(i, j);
+    FrameWriter::Format fmt = FrameWriter::format_from_target(target);
+    if (format) {
+        if      (!strcmp(format, "tga")) fmt = FrameWriter::TGA;
+        else if (!strcmp(format, "raw")) fmt = FrameWriter::RAW;
+        else if (!strcmp(format, "ppm")) fmt = FrameWriter::PPM;
+        else if (!strcmp(format, "y4m")) fmt = FrameWriter::Y4M;
+        else std::cerr << "unknown format " << format << ", using the target extension\n";
+    }
+    FrameWriter writer(target, fmt, width, height);
+    if (!writer.is_open() || (FrameWriter::TGA==fmt && nframes>1 && !writer.numbered())) {
+        if (writer.is_open()) std::cerr << nframes << " frames need a frame number in " << target << ", such as frame%04d.tga\n";
+        delete model;
+        return 1;
+    }
+    float radius = (eye-center).norm();
+    for (int f=0; f<nframes; f++) {
+        float angle = 2*M_PI*f/nframes;
+        Vec3f e = center + Vec3f(radius*std::sin(angle), eye.y-center.y, radius*std::cos(angle));
+        zbuffer.clear();
+        if (ninstances) render_crowd(ninstances, e, writer.frame(), zbuffer, pool.get(), lod_error);
+        else render(e, writer.frame(), zbuffer, intensity, pool.get(), gbuffer.get(), msaa.get(), bvh.get(), lod_error);
+        bool presented;
+        {
+            STATS_TIMER(STAGE_OUTPUT); // waits for the encoder when it is the bottleneck
+            presented = writer.present();
         }
-        triangle(screen_coords, shader, image, zbuffer);
+        if (!presented) break;
     }
-
-    image.  flip_vertically(); 
-    zbuffer.flip_vertically();
-    image.  write_tga_file("output.tga");
-    zbuffer.write_tga_file("zbuffer.tga");
-
+    bool ok;
+    {
+        STATS_TIMER(STAGE_OUTPUT); // whatever the encoder thread did not hide
+        ok = writer.close();
+    }
+#ifdef TINYRENDERER_STATS
+    if (statsfile && !stats_write_json(statsfile)) std::cerr << "can't write " << statsfile << "\n";
+#endif
+    if (!ok) std::cerr << "can't write the frames to " << target << "\n";
     delete model;
-    return 0;
+    return ok ? 0 : 1;
 }
@@ -0,0 +1,44 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mappedfile.h"
+
+MappedFile::MappedFile() : data_(NULL), size_(0), open_(false) {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const char *filename) {
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if (fd<0) return false;
+    struct stat st;
+    if (fstat(fd, &st)<0) {
+        ::close(fd);
+        return false;
+    }
+    size_ = st.st_size;
+    if (size_>0) {
+        void *p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED==p) {
+            ::close(fd);
+            size_ = 0;
+            return false;
+        }
+        data_ = (const char *)p;
+    }
+    ::close(fd); // the mapping stays valid
+    open_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) munmap((void *)data_, size_);
+    data_ = NULL;
+    size_ = 0;
+    open_ = false;
+}
+
@@ -0,0 +1,130 @@
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include "meshcache.h"
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t hash;                // of the source file contents
+    uint64_t block_size;
+    int32_t count[MESH_NCOUNTS];  // verts, normals, uvs, faces, lod faces, lods
+    char padding[8];             // the block starts MESH_ALIGNMENT aligned in the (page aligned) mapping
+};
+
+static_assert(sizeof(MeshCacheHeader)%MESH_ALIGNMENT==0, "the mesh block must stay aligned in the file");
+
+static const char mesh_cache_magic[8] = {'T','R','M','E','S','H','\0','\0'};
+
+static size_t align(size_t n) {
+    return (n+MESH_ALIGNMENT-1) & ~(MESH_ALIGNMENT-1);
+}
+
+const int MESH_NARRAYS = 13;
+
+// byte offsets of the arrays in the block: vert x,y,z, norm x,y,z, u, v, the three index arrays (model
+// and level of detail faces), then the lod ranges and errors
+static size_t mesh_layout(const int count[MESH_NCOUNTS], size_t offset[MESH_NARRAYS]) {
+    size_t sizes[MESH_NARRAYS];
+    for (int i=0; i<3; i++) sizes[i]   = count[MESH_VERTS]*sizeof(float);
+    for (int i=0; i<3; i++) sizes[3+i] = count[MESH_NORMS]*sizeof(float);
+    for (int i=0; i<2; i++) sizes[6+i] = count[MESH_UVS]  *sizeof(float);
+    for (int i=0; i<3; i++) sizes[8+i] = (count[MESH_FACES]+count[MESH_LOD_FACES])*3*sizeof(int);
+    sizes[11] = count[MESH_LODS]*2*sizeof(int);
+    sizes[12] = count[MESH_LODS]*sizeof(float);
+    size_t pos = 0;
+    for (int i=0; i<MESH_NARRAYS; i++) {
+        offset[i] = pos;
+        pos = align(pos+sizes[i]);
+    }
+    return pos;
+}
+
+size_t mesh_block_size(const int count[MESH_NCOUNTS]) {
+    size_t offset[MESH_NARRAYS];
+    return mesh_layout(count, offset);
+}
+
+void bind_mesh_block(const char *block, const int count[MESH_NCOUNTS], MeshArrays &mesh) {
+    size_t offset[MESH_NARRAYS];
+    mesh_layout(count, offset);
+    for (int i=0; i<MESH_NCOUNTS; i++) mesh.count[i] = count[i];
+    for (int i=0; i<3; i++) mesh.vert[i] = (const float *)(block+offset[i]);
+    for (int i=0; i<3; i++) mesh.norm[i] = (const float *)(block+offset[3+i]);
+    for (int i=0; i<2; i++) mesh.uv[i]   = (const float *)(block+offset[6+i]);
+    mesh.vert_idx  = (const int *)(block+offset[8]);
+    mesh.uv_idx    = (const int *)(block+offset[9]);
+    mesh.norm_idx  = (const int *)(block+offset[10]);
+    mesh.lod_range = (const int *)(block+offset[11]);
+    mesh.lod_error = (const float *)(block+offset[12]);
+}
+
+uint64_t hash_bytes(const char *data, size_t size) {
+    uint64_t h = 14695981039346656037ull ^ size; // FNV-1a over 8-byte words
+    size_t i = 0;
+    for (; i+8<=size; i+=8) {
+        uint64_t word;
+        memcpy(&word, data+i, 8);
+        h = (h ^ word)*1099511628211ull;
+        h ^= h>>29;
+    }
+    for (; i<size; i++) h = (h ^ (unsigned char)data[i])*1099511628211ull;
+    return h;
+}
+
+bool write_mesh_cache(const char *filename, uint64_t hash, const char *block, const int count[MESH_NCOUNTS]) {
+    MeshCacheHeader header;
+    memset((void *)&header, 0, sizeof(header));
+    memcpy(header.magic, mesh_cache_magic, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.header_size = sizeof(header);
+    header.hash = hash;
+    header.block_size = mesh_block_size(count);
+    for (int i=0; i<MESH_NCOUNTS; i++) header.count[i] = count[i];
+
+    std::string tmpname = std::string(filename) + ".tmp"; // written aside and renamed, a reader never sees a partial file
+    std::ofstream out(tmpname.c_str(), std::ios::binary);
+    if (!out.is_open()) return false;
+    out.write((const char *)&header, sizeof(header));
+    out.write(block, header.block_size);
+    out.close();
+    if (!out.good() || 0!=std::rename(tmpname.c_str(), filename)) {
+        std::remove(tmpname.c_str());
+        return false;
+    }
+    return true;
+}
+
+// every index and every level of detail within the counts, a stale or corrupted cache could point
+// anywhere otherwise
+static bool mesh_in_range(const MeshArrays &mesh) {
+    const int *count = mesh.count;
+    long ncorners = (long)(count[MESH_FACES]+count[MESH_LOD_FACES])*3;
+    for (long i=0; i<ncorners; i++) {
+        if (mesh.vert_idx[i]<0 || mesh.vert_idx[i]>=count[MESH_VERTS]) return false;
+        if (mesh.uv_idx[i]  <0 || mesh.uv_idx[i]  >=count[MESH_UVS])   return false;
+        if (mesh.norm_idx[i]<0 || mesh.norm_idx[i]>=count[MESH_NORMS]) return false;
+    }
+    for (int i=1; i<count[MESH_LODS]; i++) { // level 0 is the model itself, its range is not read
+        int first = mesh.lod_range[i*2], nfaces = mesh.lod_range[i*2+1];
+        if (first<0 || nfaces<0 || (long)first+nfaces>(long)count[MESH_FACES]+count[MESH_LOD_FACES]) return false;
+    }
+    return true;
+}
+
+bool read_mesh_cache(const MappedFile &file, uint64_t hash, MeshArrays &mesh) {
+    if (file.size()<sizeof(MeshCacheHeader)) return false;
+    MeshCacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, mesh_cache_magic, sizeof(header.magic)) || header.version!=MESH_CACHE_VERSION
+        || header.header_size!=sizeof(header) || header.hash!=hash) return false;
+    for (int i=0; i<MESH_NCOUNTS; i++)
+        if (header.count[i]<0) return false;
+    if (header.count[MESH_LODS]<1) return false; // level 0 is always there
+    if (header.block_size!=mesh_block_size(header.count) || sizeof(header)+header.block_size>file.size()) return false;
+    bind_mesh_block(file.data()+sizeof(header), header.count, mesh);
+    return mesh_in_range(mesh);
+}
+
@@ -1,108 +1,254 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <algorithm>
 #include "model.h"
+#include "objparser.h"
+#include "simplify.h"
+#include "reorder.h"
+#include "raster.h"
 
-Model::Model(const char *filename) : verts_(), faces_(), norms_(), uv_(), diffusemap_(), normalmap_(), specularmap_() {
-    std::ifstream in;
-    in.open (filename, std::ifstream::in);
-    if (in.fail()) return;
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            Vec3f v;
-            for (int i=0;i<3;i++) iss >> v[i];
-            verts_.push_back(v);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
-            Vec3f n;
-            for (int i=0;i<3;i++) iss >> n[i];
-            norms_.push_back(n);
-        } else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
-            Vec2f uv;
-            for (int i=0;i<2;i++) iss >> uv[i];
-            uv_.push_back(uv);
-        }  else if (!line.compare(0, 2, "f ")) {
-            std::vector<Vec3i> f;
-            Vec3i tmp;
-            iss >> trash;
-            while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2]) {
-                for (int i=0; i<3; i++) tmp[i]--; // in wavefront obj all indices start at 1, not zero
-                f.push_back(tmp);
-            }
-            faces_.push_back(f);
+Model::Model(const char *filename, bool reorder) : mesh_(), block_(), cache_(), diffusemap_(), normalmap_(), specularmap_(), filter_(Texture::TRILINEAR), bbox_min_(), bbox_max_() {
+    MappedFile obj;
+    if (!obj.open(filename)) return;
+    uint64_t hash = hash_bytes(obj.data(), obj.size());
+    std::string cachefile = std::string(filename) + (reorder ? ".reordered.mesh" : ".mesh");
+    if (!cache_.open(cachefile.c_str()) || !read_mesh_cache(cache_, hash, mesh_)) {
+        cache_.close();
+        load_obj(obj, reorder);
+        if (!write_mesh_cache(cachefile.c_str(), hash, block_.get(), mesh_.count))
+            std::cerr << "can't write the mesh cache " << cachefile << std::endl;
+    } else if (reorder) { // the order of the OBJ is not at hand, only the cached one is measured
+        std::vector<Vec3i> corners(nfaces()*3);
+        for (size_t i=0; i<corners.size(); i++) corners[i] = Vec3i(mesh_.vert_idx[i], 0, 0);
+        std::cerr << "# acmr " << acmr(corners, 0, nfaces()) << " (cached)" << std::endl;
+    }
+    std::cerr << "# v# " << nverts() << " f# "  << nfaces() << " vt# " << mesh_.count[MESH_UVS] << " vn# " << nnormals() << " lods# " << nlods() << std::endl;
+    for (int i=0; i<nverts(); i++) {
+        for (int j=0; j<3; j++) {
+            bbox_min_[j] = i ? std::min(bbox_min_[j], mesh_.vert[j][i]) : mesh_.vert[j][i];
+            bbox_max_[j] = i ? std::max(bbox_max_[j], mesh_.vert[j][i]) : mesh_.vert[j][i];
         }
     }
-    std::cerr << "# v# " << verts_.size() << " f# "  << faces_.size() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
     load_texture(filename, "_diffuse.tga", diffusemap_);
     load_texture(filename, "_nm.tga",      normalmap_);
     load_texture(filename, "_spec.tga",    specularmap_);
 }
 
+void Model::load_obj(const MappedFile &obj, bool reorder) {
+    ObjData data;
+    parse_obj(obj.data(), obj.size(), data, ThreadPool::shared());
+    std::vector<Vec3f> &verts = data.verts, &norms = data.norms;
+    std::vector<Vec2f> &uv = data.uv;
+    std::vector<Vec3i> &corners = data.corners;
+    for (size_t i=0; i<norms.size(); i++) norms[i].normalize();
+
+    // the accessors expect every corner to have a uv and a normal: corners without a uv get (0,0),
+    // corners without a normal get the average normal of the faces around their vertex
+    bool nouv = false, nonormal = false;
+    for (size_t i=0; i<corners.size(); i++) {
+        nouv     = nouv     || corners[i][1]<0;
+        nonormal = nonormal || corners[i][2]<0;
+    }
+    if (nouv) {
+        for (size_t i=0; i<corners.size(); i++)
+            if (corners[i][1]<0) corners[i][1] = (int)uv.size();
+        uv.push_back(Vec2f(0, 0));
+    }
+    if (nonormal) {
+        int base = (int)norms.size();
+        norms.resize(base+verts.size(), Vec3f(0, 0, 0));
+        for (size_t t=0; t<corners.size()/3; t++) {
+            Vec3i *c = &corners[t*3];
+            Vec3f n = cross(verts[c[1][0]]-verts[c[0][0]], verts[c[2][0]]-verts[c[0][0]]);
+            for (int j=0; j<3; j++) norms[base+c[j][0]] = norms[base+c[j][0]] + n;
+        }
+        for (size_t i=base; i<norms.size(); i++)
+            if (norms[i].norm()>0) norms[i].normalize();
+        for (size_t i=0; i<corners.size(); i++)
+            if (corners[i][2]<0) corners[i][2] = base+corners[i][0];
+    }
+
+    int ntris = (int)corners.size()/3;
+    float before = 0;
+    if (reorder) { // before the levels of detail, they inherit the new vertex numbers and the face order
+        before = acmr(corners, 0, ntris);
+        reorder_faces(verts, corners, 0, ntris);
+        reorder_vertices(verts, uv, norms, corners);
+    }
+    std::vector<LodLevel> lods;
+    build_lod_chain(verts, corners, lods);
+    if (reorder) {
+        for (size_t i=1; i<lods.size(); i++) reorder_faces(verts, corners, lods[i].first, lods[i].nfaces);
+        std::cerr << "# acmr " << before << " -> " << acmr(corners, 0, ntris) << std::endl;
+    }
+
+    // scatter into the structure-of-arrays block
+    int count[MESH_NCOUNTS] = {(int)verts.size(), (int)norms.size(), (int)uv.size(), ntris, (int)corners.size()/3-ntris, (int)lods.size()};
+    block_.reset(new (std::align_val_t(MESH_ALIGNMENT)) char[mesh_block_size(count)]());
+    bind_mesh_block(block_.get(), count, mesh_);
+    for (int i=0; i<count[MESH_VERTS]; i++)
+        for (int j=0; j<3; j++) const_cast<float *>(mesh_.vert[j])[i] = verts[i][j];
+    for (int i=0; i<count[MESH_NORMS]; i++)
+        for (int j=0; j<3; j++) const_cast<float *>(mesh_.norm[j])[i] = norms[i][j];
+    for (int i=0; i<count[MESH_UVS]; i++)
+        for (int j=0; j<2; j++) const_cast<float *>(mesh_.uv[j])[i] = uv[i][j];
+    for (size_t i=0; i<corners.size(); i++) {
+        const_cast<int *>(mesh_.vert_idx)[i] = corners[i][0];
+        const_cast<int *>(mesh_.uv_idx)  [i] = corners[i][1];
+        const_cast<int *>(mesh_.norm_idx)[i] = corners[i][2];
+    }
+    for (size_t i=0; i<lods.size(); i++) {
+        const_cast<int *>(mesh_.lod_range)[i*2]   = lods[i].first;
+        const_cast<int *>(mesh_.lod_range)[i*2+1] = lods[i].nfaces;
+        const_cast<float *>(mesh_.lod_error)[i]   = lods[i].error;
+    }
+}
+
 Model::~Model() {}
 
 int Model::nverts() {
-    return (int)verts_.size();
+    return mesh_.count[MESH_VERTS];
 }
 
 int Model::nfaces() {
-    return (int)faces_.size();
+    return mesh_.count[MESH_FACES];
 }
 
-std::vector<int> Model::face(int idx) {
-    std::vector<int> face;
-    for (int i=0; i<(int)faces_[idx].size(); i++) face.push_back(faces_[idx][i][0]);
-    return face;
+int Model::nnormals() {
+    return mesh_.count[MESH_NORMS];
+}
+
+int Model::nlods() {
+    return std::max(1, mesh_.count[MESH_LODS]); // level 0 even when the model failed to load
+}
+
+int Model::lod_first_face(int level) {
+    return level>0 ? mesh_.lod_range[level*2] : 0;
+}
+
+int Model::lod_nfaces(int level) {
+    return level>0 ? mesh_.lod_range[level*2+1] : nfaces();
+}
+
+float Model::lod_error(int level) {
+    return level>0 ? mesh_.lod_error[level] : 0.f;
+}
+
+int Model::select_lod(const Matrix &m, float max_error) {
+    // pixels per object unit, up to the perspective distortion away from the center of the view
+    float scale = std::max(proj<3>(m[0]).norm(), proj<3>(m[1]).norm());
+    float w = 1e30f;
+    for (int i=0; i<8; i++) {
+        Vec3f corner(i&1 ? bbox_max_.x : bbox_min_.x, i&2 ? bbox_max_.y : bbox_min_.y, i&4 ? bbox_max_.z : bbox_min_.z);
+        w = std::min(w, m[3]*embed<4>(corner));
+    }
+    float pixels = scale/std::max(w, NEAR_W);
+    int level = 0;
+    while (level+1<nlods() && lod_error(level+1)*pixels<=max_error) level++;
+    return level;
+}
+
+Span<const int> Model::face(int idx) {
+    return Span<const int>(mesh_.vert_idx+idx*3, 3);
 }
 
 Vec3f Model::vert(int i) {
-    return verts_[i];
+    return Vec3f(mesh_.vert[0][i], mesh_.vert[1][i], mesh_.vert[2][i]);
 }
 
 Vec3f Model::vert(int iface, int nthvert) {
-    return verts_[faces_[iface][nthvert][0]];
+    return vert(mesh_.vert_idx[iface*3+nthvert]);
+}
+
+int Model::vert_index(int iface, int nthvert) {
+    return mesh_.vert_idx[iface*3+nthvert];
 }
 
-void Model::load_texture(std::string filename, const char *suffix, TGAImage &img) {
+int Model::normal_index(int iface, int nthvert) {
+    return mesh_.norm_idx[iface*3+nthvert];
+}
+
+Span<const float> Model::verts(int coord) {
+    return Span<const float>(mesh_.vert[coord], nverts());
+}
+
+Span<const float> Model::normals(int coord) {
+    return Span<const float>(mesh_.norm[coord], nnormals());
+}
+
+Span<const float> Model::uvs(int coord) {
+    return Span<const float>(mesh_.uv[coord], mesh_.count[MESH_UVS]);
+}
+
+Span<const int> Model::vert_indices() {
+    return Span<const int>(mesh_.vert_idx, nfaces()*3);
+}
+
+Span<const int> Model::uv_indices() {
+    return Span<const int>(mesh_.uv_idx, nfaces()*3);
+}
+
+Span<const int> Model::normal_indices() {
+    return Span<const int>(mesh_.norm_idx, nfaces()*3);
+}
+
+void Model::load_texture(std::string filename, const char *suffix, Texture &tex) {
     std::string texfile(filename);
     size_t dot = texfile.find_last_of(".");
     if (dot!=std::string::npos) {
         texfile = texfile.substr(0,dot) + std::string(suffix);
+        TGAImage img;
         std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
         img.flip_vertically();
+        tex.build(img);
     }
 }
 
 TGAColor Model::diffuse(Vec2f uvf) {
-    Vec2i uv(uvf[0]*diffusemap_.get_width(), uvf[1]*diffusemap_.get_height());
-    return diffusemap_.get(uv[0], uv[1]);
+    return diffusemap_.get(0, uvf[0]*diffusemap_.get_width(), uvf[1]*diffusemap_.get_height());
 }
 
-Vec3f Model::normal(Vec2f uvf) {
-    Vec2i uv(uvf[0]*normalmap_.get_width(), uvf[1]*normalmap_.get_height());
-    TGAColor c = normalmap_.get(uv[0], uv[1]);
+static Vec3f decode_normal(TGAColor c) {
     Vec3f res;
     for (int i=0; i<3; i++)
         res[2-i] = (float)c[i]/255.f*2.f - 1.f;
     return res;
 }
 
+Vec3f Model::normal(Vec2f uvf) {
+    return decode_normal(normalmap_.get(0, uvf[0]*normalmap_.get_width(), uvf[1]*normalmap_.get_height()));
+}
+
 Vec2f Model::uv(int iface, int nthvert) {
-    return uv_[faces_[iface][nthvert][1]];
+    int idx = mesh_.uv_idx[iface*3+nthvert];
+    return Vec2f(mesh_.uv[0][idx], mesh_.uv[1][idx]);
 }
 
 float Model::specular(Vec2f uvf) {
-    Vec2i uv(uvf[0]*specularmap_.get_width(), uvf[1]*specularmap_.get_height());
-    return specularmap_.get(uv[0], uv[1])[0]/1.f;
+    return specularmap_.get(0, uvf[0]*specularmap_.get_width(), uvf[1]*specularmap_.get_height())[0]/1.f;
+}
+
+void Model::set_filter(Texture::Filter filter) {
+    filter_ = filter;
+}
+
+TGAColor Model::diffuse(Vec2f uvf, Vec2f duvdx, Vec2f duvdy) {
+    return diffusemap_.sample(uvf, diffusemap_.lod(duvdx, duvdy), filter_);
+}
+
+Vec3f Model::normal(Vec2f uvf, Vec2f duvdx, Vec2f duvdy) {
+    return decode_normal(normalmap_.sample(uvf, normalmap_.lod(duvdx, duvdy), filter_));
+}
+
+float Model::specular(Vec2f uvf, Vec2f duvdx, Vec2f duvdy) {
+    return specularmap_.sample(uvf, specularmap_.lod(duvdx, duvdy), filter_)[0]/1.f;
 }
 
 Vec3f Model::normal(int iface, int nthvert) {
-    int idx = faces_[iface][nthvert][2];
-    return norms_[idx].normalize();
+    return normal(mesh_.norm_idx[iface*3+nthvert]);
+}
+
+Vec3f Model::normal(int i) {
+    return Vec3f(mesh_.norm[0][i], mesh_.norm[1][i], mesh_.norm[2][i]); // normalized at load
 }
 
@@ -0,0 +1,77 @@
+#include "msaa.h"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// the standard sample positions, in 1/16 of a pixel: the pixel center alone, then 2x, 4x and 8x
+static const int SAMPLE_OFFSETS[1+2+4+8][2] = {
+    { 0,  0},
+    { 4,  4}, {-4, -4},
+    {-2, -6}, { 6, -2}, {-6,  2}, { 2,  6},
+    { 1, -3}, {-1,  3}, { 5,  1}, {-3, -5}, {-5,  5}, {-7, -1}, { 3,  7}, { 7, -7},
+};
+
+MultisampleBuffer::MultisampleBuffer(int w, int h, int samples, bool reversed) : width_(w), height_(h), samples_(1), depth_(), color_() {
+    while (samples_<samples && samples_<MAX_SAMPLES) samples_ *= 2;
+    for (int k=0; k<samples_; k++) depth_.push_back(DepthBuffer(w, h, reversed));
+    color_.resize(w*h*samples_);
+}
+
+void MultisampleBuffer::clear() {
+    for (int k=0; k<samples_; k++) depth_[k].clear();
+    std::fill(color_.begin(), color_.end(), 0);
+}
+
+Vec2i MultisampleBuffer::offset(int k) const {
+    const int *o = SAMPLE_OFFSETS[samples_-1+k]; // the table for n samples starts at n-1
+    return Vec2i(o[0], o[1]);
+}
+
+// rounded mean of the n (a power of 2) BGRA colors c
+static inline uint32_t average(const uint32_t *c, int n) {
+#if defined(__SSE2__)
+    if (n>=2) { // 16-bit sums of the channels, two pixels per register
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = zero;
+        if (2==n) sum = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)c), zero);
+        for (int k=0; k+4<=n; k+=4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(c+k));
+            sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)));
+        }
+        sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+        sum = _mm_srl_epi16(_mm_add_epi16(sum, _mm_set1_epi16(n/2)), _mm_cvtsi32_si128(__builtin_ctz(n)));
+        return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+    }
+#endif
+    uint32_t ret = 0;
+    for (int channel=0; channel<4; channel++) {
+        uint32_t sum = 0;
+        for (int k=0; k<n; k++) sum += (c[k]>>(channel*8)) & 0xff;
+        ret |= ((sum+n/2)/n)<<(channel*8);
+    }
+    return ret;
+}
+
+// one row of the resolve into pixels of BPP bytes
+template <int BPP> static void resolve_row(const uint32_t *samples, int n, int width, unsigned char *out) {
+    for (int x=0; x<width; x++, samples+=n, out+=BPP) {
+        uint32_t color = 1==n ? samples[0] : average(samples, n);
+        memcpy(out, &color, BPP); // BGRA, the first BPP bytes as TGAImage::set() does
+    }
+}
+
+void resolve_multisample(const MultisampleBuffer &target, TGAImage &image, ThreadPool &pool) {
+    int width  = std::min(target.get_width(),  image.get_width());
+    int height = std::min(target.get_height(), image.get_height());
+    int stride = image.get_width()*image.get_bytespp(), bytespp = image.get_bytespp(), n = target.samples();
+    unsigned char *data = image.buffer();
+    pool.parallel_for((height+RESOLVE_BAND-1)/RESOLVE_BAND, [&](int band) {
+        for (int y=band*RESOLVE_BAND; y<std::min(height, (band+1)*RESOLVE_BAND); y++) {
+            switch (bytespp) {
+                case 1:  resolve_row<1>(target.colors(0, y), n, width, data+y*stride); break;
+                case 3:  resolve_row<3>(target.colors(0, y), n, width, data+y*stride); break;
+                default: resolve_row<4>(target.colors(0, y), n, width, data+y*stride); break;
+            }
+        }
+    });
+}
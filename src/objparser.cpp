@@ -0,0 +1,164 @@
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+#include "objparser.h"
+
+const size_t MIN_CHUNK_SIZE = 64<<10;
+
+struct Chunk {
+    ObjData data;
+    std::vector<int> relative; // corner*3+attribute of every index given relative to the end of the chunk
+};
+
+static bool is_blank(char c) {
+    return ' '==c || '\t'==c || '\r'==c;
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+    while (p<end && is_blank(*p)) p++;
+    return p;
+}
+
+static const char *parse_float(const char *p, const char *end, float &v) {
+    p = skip_blanks(p, end);
+    if (p<end && '+'==*p) p++;
+    std::from_chars_result res = std::from_chars(p, end, v);
+    return res.ptr;
+}
+
+// reads a v, v/vt, v//vn or v/vt/vn corner, idx is left at 0 for the absent indices (obj indices start at 1)
+static const char *parse_corner(const char *p, const char *end, int idx[3]) {
+    idx[0] = idx[1] = idx[2] = 0;
+    for (int i=0; i<3; i++) {
+        if (i>0) {
+            if (p>=end || '/'!=*p) break;
+            p++;
+        }
+        std::from_chars_result res = std::from_chars(p, end, idx[i]);
+        if (res.ec!=std::errc()) {
+            if (0==i) return NULL;
+            idx[i] = 0;
+        }
+        p = res.ptr;
+    }
+    return p;
+}
+
+static void parse_chunk(const char *p, const char *end, Chunk &chunk) {
+    ObjData &d = chunk.data;
+    std::vector<Vec3i> poly;
+    std::vector<int> polyrel; // bit k is set if the k-th index of the corner is relative
+    while (p<end) {
+        const char *eol = (const char *)memchr(p, '\n', end-p);
+        if (!eol) eol = end;
+        p = skip_blanks(p, eol);
+        long len = eol-p;
+        if (len>=2 && 'v'==p[0] && is_blank(p[1])) {
+            Vec3f v;
+            const char *q = p+1;
+            for (int i=0; i<3; i++) q = parse_float(q, eol, v[i]);
+            d.verts.push_back(v);
+        } else if (len>=3 && 'v'==p[0] && 'n'==p[1] && is_blank(p[2])) {
+            Vec3f n;
+            const char *q = p+2;
+            for (int i=0; i<3; i++) q = parse_float(q, eol, n[i]);
+            d.norms.push_back(n);
+        } else if (len>=3 && 'v'==p[0] && 't'==p[1] && is_blank(p[2])) {
+            Vec2f uv;
+            const char *q = p+2;
+            for (int i=0; i<2; i++) q = parse_float(q, eol, uv[i]);
+            d.uv.push_back(uv);
+        } else if (len>=2 && 'f'==p[0] && is_blank(p[1])) {
+            poly.clear();
+            polyrel.clear();
+            int counts[3] = {(int)d.verts.size(), (int)d.uv.size(), (int)d.norms.size()};
+            const char *q = p+1;
+            int idx[3];
+            while ((q = parse_corner(skip_blanks(q, eol), eol, idx))) {
+                Vec3i c;
+                int rel = 0;
+                for (int k=0; k<3; k++) {
+                    if (idx[k]>0) {
+                        c[k] = idx[k]-1; // in wavefront obj all indices start at 1, not zero
+                    } else if (idx[k]<0) {
+                        c[k] = counts[k]+idx[k]; // local for now, the chunk offset is added at the merge
+                        rel |= 1<<k;
+                    } else {
+                        c[k] = -1;
+                    }
+                }
+                poly.push_back(c);
+                polyrel.push_back(rel);
+            }
+            for (int i=1; i+1<(int)poly.size(); i++) { // polygons are split into a fan of triangles
+                int fan[3] = {0, i, i+1};
+                for (int j=0; j<3; j++) {
+                    for (int k=0; k<3; k++)
+                        if (polyrel[fan[j]] & (1<<k)) chunk.relative.push_back((int)d.corners.size()*3+k);
+                    d.corners.push_back(poly[fan[j]]);
+                }
+            }
+        }
+        p = eol+1;
+    }
+}
+
+void parse_obj(const char *data, size_t size, ObjData &out, ThreadPool &pool) {
+    out.verts.clear();
+    out.norms.clear();
+    out.uv.clear();
+    out.corners.clear();
+    if (!data || !size) return;
+
+    int nchunks = (int)std::max<size_t>(1, std::min<size_t>(pool.size()*4, size/MIN_CHUNK_SIZE));
+    std::vector<size_t> bounds(nchunks+1, size);
+    bounds[0] = 0;
+    for (int i=1; i<nchunks; i++) { // every chunk starts right after a newline
+        size_t b = std::max(bounds[i-1], (size_t)i*size/nchunks);
+        const char *eol = b<size ? (const char *)memchr(data+b, '\n', size-b) : NULL;
+        bounds[i] = eol ? eol-data+1 : size;
+    }
+    std::vector<Chunk> chunks(nchunks);
+    pool.parallel_for(nchunks, [&](int i) {
+        parse_chunk(data+bounds[i], data+bounds[i+1], chunks[i]);
+    });
+
+    std::vector<Vec3i> offsets(nchunks+1); // verts/uv/norms before the chunk
+    std::vector<size_t> corner_offsets(nchunks+1, 0);
+    for (int i=0; i<nchunks; i++) {
+        const ObjData &d = chunks[i].data;
+        offsets[i+1] = Vec3i(offsets[i].x+d.verts.size(), offsets[i].y+d.uv.size(), offsets[i].z+d.norms.size());
+        corner_offsets[i+1] = corner_offsets[i]+d.corners.size();
+    }
+    out.verts  .resize(offsets[nchunks].x);
+    out.uv     .resize(offsets[nchunks].y);
+    out.norms  .resize(offsets[nchunks].z);
+    out.corners.resize(corner_offsets[nchunks]);
+    pool.parallel_for(nchunks, [&](int i) {
+        Chunk &c = chunks[i];
+        for (size_t j=0; j<c.relative.size(); j++)
+            c.data.corners[c.relative[j]/3][c.relative[j]%3] += offsets[i][c.relative[j]%3];
+        std::copy(c.data.verts  .begin(), c.data.verts  .end(), out.verts  .begin()+offsets[i].x);
+        std::copy(c.data.uv     .begin(), c.data.uv     .end(), out.uv     .begin()+offsets[i].y);
+        std::copy(c.data.norms  .begin(), c.data.norms  .end(), out.norms  .begin()+offsets[i].z);
+        std::copy(c.data.corners.begin(), c.data.corners.end(), out.corners.begin()+corner_offsets[i]);
+        c.data = ObjData();
+    });
+
+    int counts[3] = {(int)out.verts.size(), (int)out.uv.size(), (int)out.norms.size()};
+    size_t ntris = 0;
+    for (size_t t=0; t<out.corners.size()/3; t++) {
+        bool valid = true;
+        for (int j=0; j<3; j++) {
+            Vec3i &c = out.corners[t*3+j];
+            valid = valid && c[0]>=0 && c[0]<counts[0];
+            for (int k=1; k<3; k++)
+                if (c[k]<0 || c[k]>=counts[k]) c[k] = -1;
+        }
+        if (!valid) continue;
+        for (int j=0; j<3; j++) out.corners[ntris*3+j] = out.corners[t*3+j];
+        ntris++;
+    }
+    out.corners.resize(ntris*3);
+}
+
@@ -2,39 +2,80 @@
 #include <limits>
 #include <cstdlib>
 #include "our_gl.h"
+#include "model.h"
 
-Matrix ModelView;
-Matrix Viewport;
-Matrix Projection;
+thread_local Matrix ModelView;
+thread_local Matrix Viewport;
+thread_local Matrix Projection;
 
 IShader::~IShader() {}
 
-void viewport(int x, int y, int w, int h) {
-    Viewport = Matrix::identity();
-    Viewport[0][3] = x+w/2.f;
-    Viewport[1][3] = y+h/2.f;
-    Viewport[2][3] = 255.f/2.f;
-    Viewport[0][0] = w/2.f;
-    Viewport[1][1] = h/2.f;
-    Viewport[2][2] = 255.f/2.f;
+void viewport(int x, int y, int w, int h, bool reversed_z) {
+    Viewport = viewport_matrix(x, y, w, h, reversed_z);
 }
 
 void projection(float coeff) {
-    Projection = Matrix::identity();
-    Projection[3][2] = coeff;
+    Projection = projection_matrix(coeff);
 }
 
 void lookat(Vec3f eye, Vec3f center, Vec3f up) {
+    ModelView = lookat_matrix(eye, center, up);
+}
+
+Matrix viewport_matrix(int x, int y, int w, int h, bool reversed_z) {
+    Matrix m = Matrix::identity();
+    m[0][3] = x+w/2.f;
+    m[1][3] = y+h/2.f;
+    m[2][3] = .5f;
+    m[0][0] = w/2.f;
+    m[1][1] = h/2.f;
+    m[2][2] = reversed_z ? .5f : -.5f;
+    return m;
+}
+
+Matrix projection_matrix(float coeff) {
+    Matrix m = Matrix::identity();
+    m[3][2] = coeff;
+    return m;
+}
+
+Matrix lookat_matrix(Vec3f eye, Vec3f center, Vec3f up) {
     Vec3f z = (eye-center).normalize();
     Vec3f x = cross(up,z).normalize();
     Vec3f y = cross(z,x).normalize();
-    ModelView = Matrix::identity();
+    Matrix m = Matrix::identity();
     for (int i=0; i<3; i++) {
-        ModelView[0][i] = x[i];
-        ModelView[1][i] = y[i];
-        ModelView[2][i] = z[i];
-        ModelView[i][3] = -center[i];
+        m[0][i] = x[i];
+        m[1][i] = y[i];
+        m[2][i] = z[i];
+        m[i][3] = -center[i];
     }
+    return m;
+}
+
+DrawContext::DrawContext() : view(Matrix::identity()), projection(Matrix::identity()), viewport(Matrix::identity()) {
+}
+
+DrawContext::DrawContext(const Matrix &view, const Matrix &projection, const Matrix &viewport) : view(view), projection(projection), viewport(viewport) {
+}
+
+DrawContext DrawContext::current() {
+    return DrawContext(ModelView, Projection, Viewport);
+}
+
+Vec3f object_direction(const Matrix &transform, Vec3f dir) {
+    // the normals go to world space by the inverse transpose of the linear part L, so the dot products are
+    // the ones of the normals with the inverse of L applied to dir: for L = R*s, the transpose of L up to s
+    Vec3f d;
+    for (int i=0; i<3; i++) d[i] = transform[0][i]*dir[0] + transform[1][i]*dir[1] + transform[2][i]*dir[2];
+    return d.norm()>0 ? d.normalize() : d;
+}
+
+void transform_vertices(Model &model, const Matrix &m, std::vector<Vec4f> &out) {
+    STATS_SCOPE();
+    STATS_ADD(vertices, model.nverts());
+    out.resize(model.nverts());
+    transform_points(m, model.verts(0).data(), model.verts(1).data(), model.verts(2).data(), model.nverts(), out.data());
 }
 
 Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P) {
@@ -50,30 +91,224 @@ Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P) {
     return Vec3f(-1,1,1); // in this case generate negative coordinates, it will be thrown away by the rasterizator
 }
 
-void triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer) {
-    Vec2f bboxmin( std::numeric_limits<float>::max(),  std::numeric_limits<float>::max());
-    Vec2f bboxmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+Cull FaceCulling = CULL_BACK;
+
+void face_culling(Cull mode) {
+    FaceCulling = mode;
+}
+
+RasterMode Rasterization = RASTER_FLOAT;
+
+void rasterization(RasterMode mode) {
+    Rasterization = mode;
+}
+
+// signed distance-like value of v to the k-th clipping plane, >=0 inside; the planes are the near plane,
+// then x>=x0, x<=x1, y>=y0, y<=y1 in homogeneous form (x>=x0*w and so on)
+static float plane_distance(int k, const Vec4f &v, const float bounds[4]) {
+    switch (k) {
+        case 0:  return v[3] - NEAR_W;
+        case 1:  return v[0] - bounds[0]*v[3];
+        case 2:  return bounds[1]*v[3] - v[0];
+        case 3:  return v[1] - bounds[2]*v[3];
+        default: return bounds[3]*v[3] - v[1];
+    }
+}
+
+bool assemble_triangle(const Vec4f *pts, Vec2i clipmin, Vec2i clipmax, Vec2i imagesize, Primitive &prim) {
+    prim.clipped = false;
+    prim.n = 3;
+    const float frustum[4] = {clipmin.x-SNAP_SLACK, clipmax.x+SNAP_SLACK, clipmin.y-SNAP_SLACK, clipmax.y+SNAP_SLACK};
+    for (int k=0; k<5; k++) { // all three vertices on the wrong side of one plane: the whole triangle is
+        bool outside = true;
+        for (int i=0; outside && i<3; i++) outside = !(plane_distance(k, pts[i], frustum)>=0);
+        if (outside) return false;
+    }
+    const float guard[4] = {-GUARD_BAND, imagesize.x+GUARD_BAND, -GUARD_BAND, imagesize.y+GUARD_BAND};
+    int planes = 0; // the planes some vertex is out of
+    for (int k=0; k<5; k++)
+        for (int i=0; i<3; i++)
+            if (!(plane_distance(k, pts[i], guard)>=0)) planes |= 1<<k;
+    if (!planes) return true;
+
+    // Sutherland-Hodgman, one plane at a time, the barycentric coordinates are interpolated with the vertices
+    prim.clipped = true;
+    Vec4f v[2][MAX_CLIP_VERTS];
+    Vec3f bar[2][MAX_CLIP_VERTS];
+    int n = 3, cur = 0;
     for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
-            bboxmin[j] = std::min(bboxmin[j], pts[i][j]/pts[i][3]);
-            bboxmax[j] = std::max(bboxmax[j], pts[i][j]/pts[i][3]);
-        }
+        v[0][i] = pts[i];
+        bar[0][i] = Vec3f(i==0, i==1, i==2);
     }
-    Vec2i P;
-    TGAColor color;
-    for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++) {
-        for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++) {
-            Vec3f c = barycentric(proj<2>(pts[0]/pts[0][3]), proj<2>(pts[1]/pts[1][3]), proj<2>(pts[2]/pts[2][3]), proj<2>(P));
-            float z = pts[0][2]*c.x + pts[1][2]*c.y + pts[2][2]*c.z;
-            float w = pts[0][3]*c.x + pts[1][3]*c.y + pts[2][3]*c.z;
-            int frag_depth = std::max(0, std::min(255, int(z/w+.5)));
-            if (c.x<0 || c.y<0 || c.z<0 || zbuffer.get(P.x, P.y)[0]>frag_depth) continue;
-            bool discard = shader.fragment(c, color);
-            if (!discard) {
-                zbuffer.set(P.x, P.y, TGAColor(frag_depth));
-                image.set(P.x, P.y, color);
+    for (int k=0; k<5; k++) {
+        if (!(planes & (1<<k))) continue;
+        int m = 0;
+        for (int i=0; i<n; i++) {
+            int j = (i+1)%n;
+            float di = plane_distance(k, v[cur][i], guard), dj = plane_distance(k, v[cur][j], guard);
+            if (di>=0) {
+                v[1-cur][m] = v[cur][i];
+                bar[1-cur][m++] = bar[cur][i];
+            }
+            if ((di>=0) != (dj>=0)) {
+                float t = di/(di-dj);
+                v[1-cur][m] = v[cur][i] + (v[cur][j]-v[cur][i])*t;
+                bar[1-cur][m++] = bar[cur][i] + (bar[cur][j]-bar[cur][i])*t;
             }
         }
+        n = m;
+        cur = 1-cur;
+        if (n<3) return false;
     }
+    prim.n = n;
+    for (int i=0; i<n; i++) {
+        prim.v[i] = v[cur][i];
+        prim.bar[i] = bar[cur][i];
+    }
+    return true;
+}
+
+// twice the signed area of the triangle on screen, positive when counterclockwise (y up)
+static float screen_area(const Vec2f *s) {
+    return (s[1].x-s[0].x)*(s[2].y-s[0].y) - (s[2].x-s[0].x)*(s[1].y-s[0].y);
 }
 
+// the vertices in 28.4 fixed point, false when they are too far away (or NaN)
+static bool snap_vertices(const Vec2f *s, int64_t *x, int64_t *y) {
+    const float limit = 1<<24; // pixels, far beyond the guard band
+    for (int i=0; i<3; i++) {
+        if (!(std::abs(s[i].x)<limit && std::abs(s[i].y)<limit)) return false; // NaN coordinates as well
+        x[i] = std::lround(s[i].x*(1<<SUBPIXEL_BITS));
+        y[i] = std::lround(s[i].y*(1<<SUBPIXEL_BITS));
+    }
+    return true;
+}
+
+template <typename T> static bool facing_away(T area) {
+    return (CULL_BACK==FaceCulling && area<0) || (CULL_FRONT==FaceCulling && area>0);
+}
+
+static void screen_positions(const Vec4f *pts, Vec2f *s) {
+    for (int i=0; i<3; i++) s[i] = Vec2f(pts[i][0]/pts[i][3], pts[i][1]/pts[i][3]);
+}
+
+bool culled_triangle(const Vec4f *pts) {
+    Vec2f s[3];
+    screen_positions(pts, s);
+    if (RASTER_FIXED==Rasterization) {
+        int64_t x[3], y[3];
+        if (!snap_vertices(s, x, y)) return true;
+        int64_t area = (x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0]);
+        return 0==area || facing_away(area);
+    }
+    float area = screen_area(s);
+    return !(std::abs(area)>1e-2) || facing_away(area);
+}
+
+// RASTER_FLOAT part of setup_triangle()
+static bool setup_float(const Vec2f *s, Vec2i clipmin, Vec2i clipmax, float margin, TriangleSetup &t) {
+    float area = screen_area(s);
+    t.culled = !(std::abs(area)>1e-2) || facing_away(area); // degenerate triangle (or NaN coordinates)
+    if (t.culled) return false;
+
+    for (int i=0; i<3; i++) {
+        Vec2f p = s[(i+1)%3], q = s[(i+2)%3];
+        float sign = area<0 ? -1.f : 1.f; // the edge functions are made positive inside
+        // the two triangles of a shared edge take its vertices in the same order, the coefficients are then
+        // exact opposites and so is every value of the edge function, whatever the rounding
+        if (q.x<p.x || (q.x==p.x && q.y<p.y)) {
+            std::swap(p, q);
+            sign = -sign;
+        }
+        float a = p.y-q.y, b = q.x-p.x, c = -(a*p.x + b*p.y);
+        t.e[i].a = a*sign;
+        t.e[i].b = b*sign;
+        t.e[i].c = c*sign;
+        t.bias[i] = t.e[i].a>0 || (0==t.e[i].a && t.e[i].b<0) ? 0 : 1; // top-left rule, as in setup_fixed()
+    }
+    t.inv_area = 1.f/std::abs(area);
+
+    float bboxmin[2] = {std::min(s[0].x, std::min(s[1].x, s[2].x))-margin, std::min(s[0].y, std::min(s[1].y, s[2].y))-margin};
+    float bboxmax[2] = {std::max(s[0].x, std::max(s[1].x, s[2].x))+margin, std::max(s[0].y, std::max(s[1].y, s[2].y))+margin};
+    // pixels outside of the clip rectangle are never written, skip them instead of scanning the whole bbox
+    if (!(bboxmax[0]>=clipmin.x && bboxmax[1]>=clipmin.y && bboxmin[0]<clipmax.x && bboxmin[1]<clipmax.y)) return false;
+    t.xmin = (int)std::ceil(std::max(bboxmin[0], (float)clipmin.x)); t.xmax = (int)std::floor(std::min(bboxmax[0], clipmax.x-1.f));
+    t.ymin = (int)std::ceil(std::max(bboxmin[1], (float)clipmin.y)); t.ymax = (int)std::floor(std::min(bboxmax[1], clipmax.y-1.f));
+    return t.xmin<=t.xmax && t.ymin<=t.ymax;
+}
+
+// floor(n/2^SUBPIXEL_BITS), and the ceiling
+static int subpixel_floor(int64_t n) {
+    return (int)(n>=0 ? n>>SUBPIXEL_BITS : -((-n+(1<<SUBPIXEL_BITS)-1)>>SUBPIXEL_BITS));
+}
+
+static int subpixel_ceil(int64_t n) {
+    return -subpixel_floor(-n);
+}
+
+// RASTER_FIXED part of setup_triangle(), s are the screen positions of the vertices
+static bool setup_fixed(const Vec2f *s, Vec2i clipmin, Vec2i clipmax, float margin, TriangleSetup &t) {
+    int64_t x[3], y[3];
+    t.culled = true;
+    if (!snap_vertices(s, x, y)) return false;
+    int64_t area = (x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0]);
+    if (0==area || facing_away(area)) return false; // exactly degenerate once snapped
+    t.culled = false;
+    int64_t sign = area<0 ? -1 : 1; // the edge functions are made positive inside
+
+    int64_t grow = std::lround(margin*(1<<SUBPIXEL_BITS));
+    int64_t bboxmin[2] = {std::min(x[0], std::min(x[1], x[2]))-grow, std::min(y[0], std::min(y[1], y[2]))-grow};
+    int64_t bboxmax[2] = {std::max(x[0], std::max(x[1], x[2]))+grow, std::max(y[0], std::max(y[1], y[2]))+grow};
+    // the blocks scanned reach BLOCK_SIZE pixels beyond the bbox at most, that bounds the edge functions
+    int64_t slack = 2*BLOCK_SIZE<<SUBPIXEL_BITS, width = bboxmax[0]-bboxmin[0]+slack, height = bboxmax[1]-bboxmin[1]+slack;
+    t.wide = false;
+    for (int i=0; i<3; i++) {
+        int p = (i+1)%3, q = (i+2)%3;
+        int64_t a = (y[p]-y[q])*sign, b = (x[q]-x[p])*sign;
+        // top-left rule: a pixel exactly on the edge is covered when the inside is to the right of the edge
+        // (a left edge) or below a horizontal one (a top edge, y goes up); the triangle on the other side of
+        // a shared edge sees it the other way around
+        t.bias[i] = a>0 || (0==a && b<0) ? 0 : 1;
+        t.wide = t.wide || std::abs(a)*width + std::abs(b)*height >= (int64_t)1<<30;
+        t.a[i] = a*(1<<SUBPIXEL_BITS);
+        t.b[i] = b*(1<<SUBPIXEL_BITS);
+        t.c[i] = -(a*x[p] + b*y[p]);
+        t.a32[i] = (int32_t)t.a[i];
+        t.b32[i] = (int32_t)t.b[i];
+    }
+    t.inv_area = 1.f/(float)(area*sign);
+
+    t.xmin = std::max(subpixel_ceil(bboxmin[0]), clipmin.x); t.xmax = std::min(subpixel_floor(bboxmax[0]), clipmax.x-1);
+    t.ymin = std::max(subpixel_ceil(bboxmin[1]), clipmin.y); t.ymax = std::min(subpixel_floor(bboxmax[1]), clipmax.y-1);
+    return t.xmin<=t.xmax && t.ymin<=t.ymax;
+}
+
+bool setup_triangle(const Vec4f *pts, const DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax, TriangleSetup &t, float margin) {
+    Vec2f s[3];
+    screen_positions(pts, s);
+    t.fixed = RASTER_FIXED==Rasterization;
+    if (!(t.fixed ? setup_fixed(s, clipmin, clipmax, margin, t) : setup_float(s, clipmin, clipmax, margin, t))) return false;
+
+    t.nearest = pts[0][2]/pts[0][3]; // depth is a linear fractional function, its extrema are at the vertices
+    for (int i=1; i<3; i++) {
+        float z = pts[i][2]/pts[i][3];
+        if (zbuffer.closer(z, t.nearest)) t.nearest = z;
+    }
+    return true;
+}
+
+void depth_triangle(const Vec4f *pts, DepthBuffer &zbuffer) {
+    STATS_SCOPE();
+    STATS_ADD(triangles_submitted, 1);
+    Vec2i size(zbuffer.get_width(), zbuffer.get_height());
+    DepthOnly depth_only;
+    draw_triangle(pts, size, zbuffer, Vec2i(0, 0), size, depth_only);
+}
+
+void triangle(Vec4f *pts, IShader &shader, TGAImage &image, DepthBuffer &zbuffer) {
+    triangle<IShader>(pts, shader, image, zbuffer);
+}
+
+void triangle(Vec4f *pts, IShader &shader, TGAImage &image, DepthBuffer &zbuffer, Vec2i clipmin, Vec2i clipmax) {
+    triangle<IShader>(pts, shader, image, zbuffer, clipmin, clipmax);
+}
@@ -0,0 +1,134 @@
+#include <cstdint>
+#include <algorithm>
+#include "reorder.h"
+
+float acmr(const std::vector<Vec3i> &corners, int first, int nfaces, int cache_size) {
+    if (nfaces<=0) return 0;
+    int nverts = 0;
+    for (int i=first*3; i<(first+nfaces)*3; i++) nverts = std::max(nverts, corners[i][0]+1);
+    // a vertex is in the FIFO when less than cache_size misses happened since its own
+    std::vector<int> stamp(nverts, -cache_size-1);
+    int misses = 0;
+    for (int i=first*3; i<(first+nfaces)*3; i++) {
+        int v = corners[i][0];
+        if (misses-stamp[v]<=cache_size) continue;
+        stamp[v] = misses++;
+    }
+    return (float)misses/nfaces;
+}
+
+// 10 bits of x spread over every third bit
+static uint32_t spread_bits(uint32_t x) {
+    x = (x | (x<<16)) & 0x030000ff;
+    x = (x | (x<< 8)) & 0x0300f00f;
+    x = (x | (x<< 4)) & 0x030c30c3;
+    x = (x | (x<< 2)) & 0x09249249;
+    return x;
+}
+
+void reorder_faces(const std::vector<Vec3f> &verts, std::vector<Vec3i> &corners, int first, int nfaces, int cache_size) {
+    if (nfaces<2) return;
+    Vec3i *faces = &corners[first*3];
+    int nverts = (int)verts.size();
+
+    // Morton order of the centroids
+    std::vector<Vec3f> centroids(nfaces);
+    Vec3f lo = verts[faces[0][0]], hi = lo;
+    for (int f=0; f<nfaces; f++) {
+        centroids[f] = (verts[faces[f*3][0]] + verts[faces[f*3+1][0]] + verts[faces[f*3+2][0]])/3.f;
+        for (int j=0; j<3; j++) {
+            lo[j] = std::min(lo[j], centroids[f][j]);
+            hi[j] = std::max(hi[j], centroids[f][j]);
+        }
+    }
+    std::vector<std::pair<uint32_t, int> > keys(nfaces);
+    for (int f=0; f<nfaces; f++) {
+        uint32_t code = 0;
+        for (int j=0; j<3; j++) {
+            float t = hi[j]>lo[j] ? (centroids[f][j]-lo[j])/(hi[j]-lo[j]) : 0.f;
+            code |= spread_bits((uint32_t)std::min(1023.f, std::max(0.f, t*1023.f)))<<j;
+        }
+        keys[f] = std::make_pair(code, f);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<Vec3i> sorted(nfaces*3);
+    for (int f=0; f<nfaces; f++)
+        for (int j=0; j<3; j++) sorted[f*3+j] = faces[keys[f].second*3+j];
+
+    // faces around every vertex, and the vertices in the order of the curve for the dead ends
+    std::vector<int> start(nverts+1, 0), adjacent(nfaces*3), live(nverts, 0), order;
+    for (int i=0; i<nfaces*3; i++) start[sorted[i][0]+1]++;
+    for (int v=0; v<nverts; v++) start[v+1] += start[v];
+    for (int i=0; i<nfaces*3; i++) {
+        int v = sorted[i][0];
+        if (0==live[v]) order.push_back(v);
+        adjacent[start[v]+live[v]++] = i/3;
+    }
+
+    // Tipsify: fan around the vertex that is the most likely to still be in the cache once its remaining
+    // faces are emitted, else back to the last vertices emitted, else to the next one along the curve
+    std::vector<int> stamp(nverts, 0), deadend, candidates, out;
+    std::vector<unsigned char> emitted(nfaces, 0);
+    out.reserve(nfaces);
+    int time = cache_size+1;
+    size_t cursor = 0;
+    int fan = order[0];
+    while (fan>=0) {
+        candidates.clear();
+        for (int k=start[fan]; k<start[fan+1]; k++) {
+            int f = adjacent[k];
+            if (emitted[f]) continue;
+            emitted[f] = 1;
+            out.push_back(f);
+            for (int j=0; j<3; j++) {
+                int v = sorted[f*3+j][0];
+                deadend.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time-stamp[v]>cache_size) stamp[v] = time++;
+            }
+        }
+        fan = -1;
+        int best = -1;
+        for (size_t k=0; k<candidates.size(); k++) {
+            int v = candidates[k];
+            if (live[v]<=0) continue;
+            int priority = time-stamp[v]+2*live[v]<=cache_size ? time-stamp[v] : 0;
+            if (priority>best) {
+                best = priority;
+                fan = v;
+            }
+        }
+        while (fan<0 && !deadend.empty()) {
+            if (live[deadend.back()]>0) fan = deadend.back();
+            deadend.pop_back();
+        }
+        for (; fan<0 && cursor<order.size(); cursor++)
+            if (live[order[cursor]]>0) fan = order[cursor];
+    }
+    for (int f=0; f<nfaces; f++)
+        for (int j=0; j<3; j++) faces[f*3+j] = sorted[out[f]*3+j];
+}
+
+// values renumbered in the order the given attribute of the corners first uses them
+template <typename T> static void renumber(std::vector<T> &values, std::vector<Vec3i> &corners, int attribute) {
+    std::vector<int> remap(values.size(), -1);
+    int next = 0;
+    for (size_t i=0; i<corners.size(); i++) {
+        int idx = corners[i][attribute];
+        if (idx>=0 && remap[idx]<0) remap[idx] = next++;
+    }
+    for (size_t i=0; i<values.size(); i++)
+        if (remap[i]<0) remap[i] = next++;
+    std::vector<T> renumbered(values.size());
+    for (size_t i=0; i<values.size(); i++) renumbered[remap[i]] = values[i];
+    values.swap(renumbered);
+    for (size_t i=0; i<corners.size(); i++)
+        if (corners[i][attribute]>=0) corners[i][attribute] = remap[corners[i][attribute]];
+}
+
+void reorder_vertices(std::vector<Vec3f> &verts, std::vector<Vec2f> &uv, std::vector<Vec3f> &norms, std::vector<Vec3i> &corners) {
+    renumber(verts, corners, 0);
+    renumber(uv,    corners, 1);
+    renumber(norms, corners, 2);
+}
@@ -0,0 +1,5 @@
+#include "shaders.h"
+
+Model *model = NULL;
+Vec3f light_dir(1, 1, 1);
+
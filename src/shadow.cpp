@@ -0,0 +1,50 @@
+#include <cmath>
+#include "shadow.h"
+#include "model.h"
+#include "our_gl.h"
+
+ShadowMap::ShadowMap(int size) : size_(size), light_(Matrix::identity()), depth_(size, size) {
+}
+
+void ShadowMap::look(Vec3f dir, Vec3f center, float radius) {
+    Vec3f up = std::abs(dir.y)<.9f*dir.norm() ? Vec3f(0, 1, 0) : Vec3f(1, 0, 0); // any axis away from dir
+    Matrix view = lookat_matrix(dir, Vec3f(0, 0, 0), up);
+    Matrix fit = Matrix::identity(); // the sphere seen from the light to [-1,1]^3
+    for (int i=0; i<3; i++) {
+        fit[i][i] = 1.f/radius;
+        fit[i][3] = -(view[i][0]*center.x + view[i][1]*center.y + view[i][2]*center.z)/radius;
+    }
+    light_ = viewport_matrix(1, 1, size_-2, size_-2)*fit*view; // a texel of border for the filter
+}
+
+void ShadowMap::clear() {
+    depth_.clear();
+}
+
+void ShadowMap::draw(Model &model, const Vec4f *verts, int level) {
+    int first = model.lod_first_face(level), last = first+model.lod_nfaces(level);
+    for (int i=first; i<last; i++) {
+        Vec4f pts[3];
+        for (int j=0; j<3; j++) pts[j] = verts[model.vert_index(i, j)];
+        depth_triangle(pts, depth_);
+    }
+}
+
+float ShadowMap::lit(Vec3f p, float bias) const {
+    if (!(std::abs(p.x)<2*size_ && std::abs(p.y)<2*size_)) return 1.f; // far out of the map, or NaN
+    float ref = depth_.reversed() ? p.z+bias : p.z-bias; // the texels closer than ref occlude p
+    int x0 = (int)std::floor(p.x), y0 = (int)std::floor(p.y);
+    float tx = p.x-x0, ty = p.y-y0;
+    float sum = 0;
+    for (int j=-PCF_RADIUS; j<=PCF_RADIUS+1; j++) {
+        int y = y0+j;
+        float wy = j==-PCF_RADIUS ? 1-ty : (j==PCF_RADIUS+1 ? ty : 1);
+        for (int i=-PCF_RADIUS; i<=PCF_RADIUS+1; i++) {
+            int x = x0+i;
+            float wx = i==-PCF_RADIUS ? 1-tx : (i==PCF_RADIUS+1 ? tx : 1);
+            bool occluded = x>=0 && y>=0 && x<size_ && y<size_ && depth_.closer(depth_.get(x, y), ref);
+            if (!occluded) sum += wx*wy;
+        }
+    }
+    return sum/((2*PCF_RADIUS+1)*(2*PCF_RADIUS+1));
+}
@@ -0,0 +1,290 @@
+#include <cmath>
+#include <queue>
+#include <cstdint>
+#include <algorithm>
+#include "simplify.h"
+
+const double BORDER_WEIGHT = 10.; // of the planes holding the borders and seams, a face plane weighs 1
+
+// symmetric 4x4 matrix of the sum of the squared distances to a set of planes
+struct Quadric {
+    double a[10]; // xx xy xz xw yy yz yw zz zw ww
+    Quadric() {
+        std::fill(a, a+10, 0.);
+    }
+    void add_plane(const Vec3f &n, float d, double weight) {
+        double p[4] = {n.x, n.y, n.z, d};
+        for (int i=0, k=0; i<4; i++)
+            for (int j=i; j<4; j++) a[k++] += weight*p[i]*p[j];
+    }
+    void add(const Quadric &q) {
+        for (int i=0; i<10; i++) a[i] += q.a[i];
+    }
+    double eval(const Vec3f &v) const {
+        double x = v.x, y = v.y, z = v.z;
+        return a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x
+                        +   a[4]*y*y + 2*a[5]*y*z + 2*a[6]*y
+                                     +   a[7]*z*z + 2*a[8]*z
+                                                  +   a[9];
+    }
+};
+
+// the cheapest collapse of u, there is one in the queue per vertex
+struct Collapse {
+    float cost;
+    int u, v;            // u goes onto v
+    unsigned version;    // of u when it was computed
+    bool operator <(const Collapse &c) const { return cost>c.cost || (cost==c.cost && u>c.u); } // the cheapest on top
+};
+
+// uv and normal of a corner, the collapses must keep them in pairs
+struct Wedge {
+    int uv, norm;
+    bool operator ==(const Wedge &w) const { return uv==w.uv && norm==w.norm; }
+};
+
+class Simplifier {
+public:
+    Simplifier(const std::vector<Vec3f> &verts, const std::vector<Vec3i> &corners);
+    int nfaces() const { return nalive_; }
+    float error() const { return error_; }
+    bool step(); // one collapse, false when nothing can be collapsed any more
+    void append_faces(std::vector<Vec3i> &out) const;
+private:
+    int corner(int f, int vert) const; // j such that corners_[f*3+j] is vert, -1 if none
+    void neighbors(int vert, std::vector<int> &out);
+    float cost(int u, int v) const;
+    void push(int u, float after_cost=-1.f, int after_v=-1);
+    bool collapse(int u, int v);
+
+    const std::vector<Vec3f> &verts_;
+    std::vector<Vec3i> corners_;
+    std::vector<unsigned char> face_alive_;
+    std::vector<std::vector<int> > vert_faces_;
+    std::vector<Quadric> quadrics_;
+    std::vector<unsigned> version_;
+    std::vector<int> target_; // v of the collapse of u in the queue, -1 if none
+    std::vector<unsigned char> vert_alive_;
+    std::priority_queue<Collapse> queue_;
+    int nalive_;
+    float error_;
+    std::vector<int> nu_, nv_; // scratch
+    std::vector<std::pair<Wedge, Wedge> > wedges_;
+};
+
+static Vec3f face_normal(const Vec3f &a, const Vec3f &b, const Vec3f &c) {
+    return cross(b-a, c-a);
+}
+
+Simplifier::Simplifier(const std::vector<Vec3f> &verts, const std::vector<Vec3i> &corners) : verts_(verts), corners_(corners),
+    face_alive_(corners.size()/3, 1), vert_faces_(verts.size()), quadrics_(verts.size()), version_(verts.size(), 0), target_(verts.size(), -1),
+    vert_alive_(verts.size(), 1), queue_(), nalive_(0), error_(0), nu_(), nv_(), wedges_() {
+    int nf = (int)corners_.size()/3;
+    for (int f=0; f<nf; f++) {
+        const Vec3i *c = &corners_[f*3];
+        if (c[0][0]==c[1][0] || c[1][0]==c[2][0] || c[2][0]==c[0][0]) { // degenerate, left out of the levels
+            face_alive_[f] = 0;
+            continue;
+        }
+        nalive_++;
+        Vec3f n = face_normal(verts_[c[0][0]], verts_[c[1][0]], verts_[c[2][0]]);
+        if (n.norm()>0) {
+            n.normalize();
+            for (int j=0; j<3; j++) quadrics_[c[j][0]].add_plane(n, -(n*verts_[c[0][0]]), 1.);
+        }
+        for (int j=0; j<3; j++) vert_faces_[c[j][0]].push_back(f);
+    }
+
+    // every edge once, with the faces around it: (smaller vertex, bigger vertex) packed in a key
+    std::vector<std::pair<uint64_t, int> > edges;
+    edges.reserve(nalive_*3);
+    for (int f=0; f<nf; f++) {
+        if (!face_alive_[f]) continue;
+        for (int j=0; j<3; j++) {
+            int a = corners_[f*3+j][0], b = corners_[f*3+(j+1)%3][0];
+            edges.push_back(std::make_pair((uint64_t)std::min(a, b)<<32 | (uint32_t)std::max(a, b), f));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i=0, j; i<edges.size(); i=j) {
+        for (j=i+1; j<edges.size() && edges[j].first==edges[i].first; j++);
+        int a = (int)(edges[i].first>>32), b = (int)(edges[i].first&0xffffffffu);
+        bool constrained = j-i!=2; // open border, or non-manifold
+        if (!constrained) { // a seam if the corners of a or of b do not match across the edge
+            int f = edges[i].second, g = edges[i+1].second;
+            for (int k=0; k<2; k++) {
+                int vert = k ? b : a;
+                const Vec3i &cf = corners_[f*3+corner(f, vert)], &cg = corners_[g*3+corner(g, vert)];
+                constrained = constrained || cf[1]!=cg[1] || cf[2]!=cg[2];
+            }
+        }
+        if (constrained) { // planes through the edge, perpendicular to the faces
+            for (size_t k=i; k<j; k++) {
+                const Vec3i *c = &corners_[edges[k].second*3];
+                Vec3f e = verts_[b]-verts_[a];
+                Vec3f n = cross(e, face_normal(verts_[c[0][0]], verts_[c[1][0]], verts_[c[2][0]]));
+                if (!(n.norm()>0)) continue;
+                n.normalize();
+                quadrics_[a].add_plane(n, -(n*verts_[a]), BORDER_WEIGHT);
+                quadrics_[b].add_plane(n, -(n*verts_[a]), BORDER_WEIGHT);
+            }
+        }
+    }
+    for (int i=0; i<(int)verts_.size(); i++) push(i);
+}
+
+int Simplifier::corner(int f, int vert) const {
+    for (int j=0; j<3; j++)
+        if (corners_[f*3+j][0]==vert) return j;
+    return -1;
+}
+
+void Simplifier::neighbors(int vert, std::vector<int> &out) {
+    out.clear();
+    std::vector<int> &faces = vert_faces_[vert];
+    size_t n = 0;
+    for (size_t i=0; i<faces.size(); i++) { // drops the dead faces on the way
+        int f = faces[i];
+        if (!face_alive_[f]) continue;
+        faces[n++] = f;
+        for (int j=0; j<3; j++)
+            if (corners_[f*3+j][0]!=vert) out.push_back(corners_[f*3+j][0]);
+    }
+    faces.resize(n);
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+float Simplifier::cost(int u, int v) const {
+    Quadric q = quadrics_[u];
+    q.add(quadrics_[v]);
+    return (float)std::max(0., q.eval(verts_[v]));
+}
+
+// queues the cheapest collapse of u that comes after (after_cost, after_v), the one that was just rejected
+void Simplifier::push(int u, float after_cost, int after_v) {
+    Collapse best{0.f, u, -1, version_[u]};
+    const std::vector<int> &faces = vert_faces_[u];
+    for (size_t i=0; i<faces.size(); i++) { // the neighbors come twice around u, no need to sort them out
+        int f = faces[i];
+        if (!face_alive_[f]) continue;
+        for (int j=0; j<3; j++) {
+            int v = corners_[f*3+j][0];
+            if (v==u) continue;
+            float c = cost(u, v);
+            if (c<after_cost || (c==after_cost && v<=after_v)) continue;
+            if (best.v<0 || c<best.cost || (c==best.cost && v<best.v)) {
+                best.cost = c;
+                best.v = v;
+            }
+        }
+    }
+    target_[u] = best.v;
+    if (best.v>=0) queue_.push(best);
+}
+
+bool Simplifier::collapse(int u, int v) {
+    neighbors(u, nu_);
+    if (!std::binary_search(nu_.begin(), nu_.end(), v)) return false; // not an edge any more
+    neighbors(v, nv_);
+    // link condition: the vertices next to both are the third vertices of the faces around the edge
+    int common = 0, shared = 0;
+    for (size_t i=0; i<nu_.size(); i++) common += std::binary_search(nv_.begin(), nv_.end(), nu_[i]);
+    const std::vector<int> &faces = vert_faces_[u];
+    for (size_t i=0; i<faces.size(); i++) shared += corner(faces[i], v)>=0;
+    if (shared>2 || common!=shared) return false;
+
+    // the corners of u take the uv and normal v has in the faces of the edge, the same on both sides
+    wedges_.clear();
+    for (size_t i=0; i<faces.size(); i++) {
+        int f = faces[i], jv = corner(f, v);
+        if (jv<0) continue;
+        const Vec3i &cu = corners_[f*3+corner(f, u)], &cv = corners_[f*3+jv];
+        Wedge from{cu[1], cu[2]}, to{cv[1], cv[2]};
+        for (size_t k=0; k<wedges_.size(); k++)
+            if (wedges_[k].first==from && !(wedges_[k].second==to)) return false;
+        wedges_.push_back(std::make_pair(from, to));
+    }
+    for (size_t i=0; i<faces.size(); i++) {
+        int f = faces[i];
+        if (corner(f, v)>=0) continue;
+        const Vec3i &cu = corners_[f*3+corner(f, u)];
+        bool mapped = false; // a corner of u on a seam side that the edge does not reach
+        for (size_t k=0; !mapped && k<wedges_.size(); k++) mapped = wedges_[k].first==Wedge{cu[1], cu[2]};
+        if (!mapped) return false;
+        Vec3f p[3], q[3];
+        for (int j=0; j<3; j++) {
+            p[j] = verts_[corners_[f*3+j][0]];
+            q[j] = corners_[f*3+j][0]==u ? verts_[v] : p[j];
+        }
+        if (!(face_normal(p[0], p[1], p[2])*face_normal(q[0], q[1], q[2])>0)) return false; // would flip
+    }
+
+    for (size_t i=0; i<faces.size(); i++) {
+        int f = faces[i];
+        if (corner(f, v)>=0) {
+            face_alive_[f] = 0;
+            nalive_--;
+            continue;
+        }
+        Vec3i &cu = corners_[f*3+corner(f, u)];
+        for (size_t k=0; k<wedges_.size(); k++) {
+            if (!(wedges_[k].first==Wedge{cu[1], cu[2]})) continue;
+            cu = Vec3i(v, wedges_[k].second.uv, wedges_[k].second.norm);
+            break;
+        }
+        vert_faces_[v].push_back(f);
+    }
+    vert_faces_[u].clear();
+    vert_alive_[u] = 0;
+    quadrics_[v].add(quadrics_[u]);
+    target_[u] = -1;
+    // the quadric of v grew, so the collapses onto v got dearer and the ones onto u are gone: a neighbor
+    // queued for anything else keeps its collapse, the others are computed again, with v itself
+    neighbors(v, nv_);
+    nv_.push_back(v);
+    for (size_t i=0; i<nv_.size(); i++) {
+        int w = nv_[i];
+        if (w!=v && target_[w]>=0 && target_[w]!=u && target_[w]!=v) continue;
+        version_[w]++;
+        push(w);
+    }
+    return true;
+}
+
+bool Simplifier::step() {
+    while (!queue_.empty()) {
+        Collapse c = queue_.top();
+        queue_.pop();
+        if (!vert_alive_[c.u] || version_[c.u]!=c.version) continue; // stale
+        if (!collapse(c.u, c.v)) {
+            push(c.u, c.cost, c.v);
+            continue;
+        }
+        error_ = std::max(error_, std::sqrt(c.cost));
+        return true;
+    }
+    return false;
+}
+
+void Simplifier::append_faces(std::vector<Vec3i> &out) const {
+    for (size_t f=0; f<face_alive_.size(); f++)
+        if (face_alive_[f]) out.insert(out.end(), corners_.begin()+f*3, corners_.begin()+f*3+3);
+}
+
+void build_lod_chain(const std::vector<Vec3f> &verts, std::vector<Vec3i> &corners, std::vector<LodLevel> &levels) {
+    int nfaces = (int)corners.size()/3;
+    levels.assign(1, LodLevel{0, nfaces, 0.f});
+    if (nfaces/4<MIN_LOD_FACES) return;
+    Simplifier s(verts, corners);
+    int target = nfaces/4;
+    while ((int)levels.size()<MAX_LODS && target>=MIN_LOD_FACES) {
+        bool more = true;
+        while (s.nfaces()>target && (more = s.step()));
+        if (s.nfaces()*4>levels.back().nfaces*3) break; // stuck well above the target, not worth a level
+        levels.push_back(LodLevel{(int)corners.size()/3, s.nfaces(), s.error()});
+        s.append_faces(corners);
+        if (!more) break;
+        target = s.nfaces()/4;
+    }
+}
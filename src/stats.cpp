@@ -0,0 +1,108 @@
+#include "stats.h"
+
+#ifdef TINYRENDERER_STATS
+
+#include <mutex>
+#include <string>
+#include <cstdio>
+#include <algorithm>
+
+static std::mutex registry_mutex;
+static std::vector<PipelineStats *> registry; // the counters of the live threads
+static PipelineStats retired = PipelineStats();  // what the exited threads counted
+
+Heatmap stats_heatmap;
+
+static void accumulate(PipelineStats &dst, const PipelineStats &src) {
+    dst.vertices            += src.vertices;
+    dst.triangles_submitted += src.triangles_submitted;
+    dst.triangles_culled    += src.triangles_culled;
+    dst.blocks_rejected     += src.blocks_rejected;
+    dst.pixels_tested       += src.pixels_tested;
+    dst.fragments_shaded    += src.fragments_shaded;
+    dst.depth_failed        += src.depth_failed;
+    dst.discarded           += src.discarded;
+    for (int i=0; i<STAGE_COUNT; i++) dst.stage_ns[i] += src.stage_ns[i];
+}
+
+namespace {
+struct ThreadStats {
+    PipelineStats stats;
+    ThreadStats() : stats() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(&stats);
+    }
+    ~ThreadStats() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        accumulate(retired, stats);
+        registry.erase(std::find(registry.begin(), registry.end(), &stats));
+    }
+};
+}
+
+PipelineStats &pipeline_stats() {
+    static thread_local ThreadStats local;
+    return local.stats;
+}
+
+PipelineStats stats_total() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    PipelineStats total = retired;
+    for (size_t i=0; i<registry.size(); i++) accumulate(total, *registry[i]);
+    return total;
+}
+
+void stats_reset() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    retired = PipelineStats();
+    for (size_t i=0; i<registry.size(); i++) *registry[i] = PipelineStats();
+}
+
+void stats_heatmap_begin(int width, int height) {
+    stats_heatmap.counts.assign((size_t)width*height, 0);
+    stats_heatmap.width = width;
+}
+
+TGAImage stats_heatmap_image() {
+    int w = stats_heatmap.width, h = w ? (int)(stats_heatmap.counts.size()/w) : 0;
+    TGAImage img(w, h, TGAImage::RGB);
+    unsigned int maxcount = 0;
+    for (size_t i=0; i<stats_heatmap.counts.size(); i++) maxcount = std::max(maxcount, stats_heatmap.counts[i]);
+    const float ramp[5][3] = {{0, 0, 0}, {0, 0, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}};
+    for (int y=0; y<h; y++) {
+        for (int x=0; x<w; x++) {
+            unsigned int n = stats_heatmap.counts[x+y*w];
+            if (!n) continue;
+            float t = maxcount>1 ? 1 + 3.f*(n-1)/(maxcount-1) : 1; // a single fragment is blue
+            int i = std::min(3, (int)t);
+            float f = t-i;
+            img.set(x, y, TGAColor(ramp[i][0] + (ramp[i+1][0]-ramp[i][0])*f,
+                                   ramp[i][1] + (ramp[i+1][1]-ramp[i][1])*f,
+                                   ramp[i][2] + (ramp[i+1][2]-ramp[i][2])*f));
+        }
+    }
+    return img;
+}
+
+bool stats_write_json(const char *filename) {
+    FILE *f = std::string(filename)=="-" ? stdout : fopen(filename, "w");
+    if (!f) return false;
+    PipelineStats s = stats_total();
+    fprintf(f, "{\n");
+    fprintf(f, "  \"vertices\": %ld,\n",            s.vertices);
+    fprintf(f, "  \"triangles_submitted\": %ld,\n", s.triangles_submitted);
+    fprintf(f, "  \"triangles_culled\": %ld,\n",    s.triangles_culled);
+    fprintf(f, "  \"blocks_rejected\": %ld,\n",     s.blocks_rejected);
+    fprintf(f, "  \"pixels_tested\": %ld,\n",       s.pixels_tested);
+    fprintf(f, "  \"fragments_shaded\": %ld,\n",    s.fragments_shaded);
+    fprintf(f, "  \"depth_failed\": %ld,\n",        s.depth_failed);
+    fprintf(f, "  \"discarded\": %ld,\n",           s.discarded);
+    fprintf(f, "  \"stage_ms\": {\"vertex\": %.3f, \"raster\": %.3f, \"output\": %.3f}\n",
+            s.stage_ns[STAGE_VERTEX]*1e-6, s.stage_ns[STAGE_RASTER]*1e-6, s.stage_ns[STAGE_OUTPUT]*1e-6);
+    fprintf(f, "}\n");
+    bool ok = !ferror(f);
+    if (f!=stdout) ok = !fclose(f) && ok;
+    return ok;
+}
+
+#endif
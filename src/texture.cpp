@@ -0,0 +1,118 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "texture.h"
+
+const int TEX_TILE = 8; // tiles are TEX_TILE x TEX_TILE texels, 256 bytes
+
+// index of (x,y) inside a tile, x bits go to the even positions, y bits to the odd ones
+static const unsigned char morton_spread[TEX_TILE] = {0, 1, 4, 5, 16, 17, 20, 21};
+
+Texture::Texture() : levels_(), bytespp_(0) {
+}
+
+inline const unsigned char *Texture::texel(const Level &l, int x, int y) const {
+    int tile = (y>>3)*l.ntiles_x + (x>>3); // x and y are never negative here
+    int idx  = morton_spread[x&7] | (morton_spread[y&7]<<1);
+    return &l.texels[(tile*TEX_TILE*TEX_TILE + idx)*4];
+}
+
+void Texture::build(TGAImage &img) {
+    levels_.clear();
+    bytespp_ = img.get_bytespp();
+    int w = img.get_width(), h = img.get_height();
+    if (w<=0 || h<=0 || !img.buffer()) return;
+    while (true) {
+        Level l;
+        l.width  = w;
+        l.height = h;
+        l.ntiles_x = (w+TEX_TILE-1)/TEX_TILE;
+        l.texels.resize(l.ntiles_x*((h+TEX_TILE-1)/TEX_TILE)*TEX_TILE*TEX_TILE*4, 0);
+        levels_.push_back(l);
+        if (1==w && 1==h) break;
+        w = std::max(1, w/2);
+        h = std::max(1, h/2);
+    }
+
+    Level &base = levels_[0];
+    for (int y=0; y<base.height; y++) {
+        for (int x=0; x<base.width; x++) {
+            TGAColor c = img.get(x, y);
+            memcpy((void *)texel(base, x, y), c.bgra, 4);
+        }
+    }
+    for (size_t i=1; i<levels_.size(); i++) {
+        const Level &src = levels_[i-1];
+        Level &dst = levels_[i];
+        for (int y=0; y<dst.height; y++) {
+            for (int x=0; x<dst.width; x++) {
+                int x0 = std::min(2*x, src.width-1),  x1 = std::min(2*x+1, src.width-1);
+                int y0 = std::min(2*y, src.height-1), y1 = std::min(2*y+1, src.height-1);
+                const unsigned char *p[4] = {texel(src, x0, y0), texel(src, x1, y0), texel(src, x0, y1), texel(src, x1, y1)};
+                unsigned char *out = (unsigned char *)texel(dst, x, y);
+                for (int c=0; c<4; c++) out[c] = (p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2)/4;
+            }
+        }
+    }
+}
+
+TGAColor Texture::get(int level, int x, int y) const {
+    if (level<0 || level>=nlevels()) return TGAColor();
+    const Level &l = levels_[level];
+    if (x<0 || y<0 || x>=l.width || y>=l.height) return TGAColor();
+    return TGAColor(texel(l, x, y), bytespp_);
+}
+
+TGAColor Texture::bilinear(int level, Vec2f uv) const {
+    const Level &l = levels_[level];
+    float x = uv.x*l.width - .5f, y = uv.y*l.height - .5f;
+    float fx0 = std::floor(x), fy0 = std::floor(y);
+    int wx = (int)((x-fx0)*256.f), wy = (int)((y-fy0)*256.f); // 8-bit fixed point weights
+    int x0 = std::max(0, std::min(l.width -1, (int)fx0)), x1 = std::max(0, std::min(l.width -1, (int)fx0+1));
+    int y0 = std::max(0, std::min(l.height-1, (int)fy0)), y1 = std::max(0, std::min(l.height-1, (int)fy0+1));
+    const unsigned char *p00 = texel(l, x0, y0), *p10 = texel(l, x1, y0);
+    const unsigned char *p01 = texel(l, x0, y1), *p11 = texel(l, x1, y1);
+    unsigned char res[4];
+    for (int c=0; c<4; c++) {
+        int top    = p00[c]*256 + (p10[c]-p00[c])*wx;
+        int bottom = p01[c]*256 + (p11[c]-p01[c])*wx;
+        res[c] = (unsigned char)((top*256 + (bottom-top)*wy + (1<<15))>>16);
+    }
+    return TGAColor(res, bytespp_);
+}
+
+TGAColor Texture::sample(Vec2f uv, float lod, Filter filter) const {
+    if (empty()) return TGAColor();
+    lod = std::max(0.f, std::min(lod, nlevels()-1.f)); // NaN goes to 0 as well
+    if (NEAREST==filter) {
+        int level = (int)(lod+.5f);
+        return get(level, uv.x*levels_[level].width, uv.y*levels_[level].height);
+    }
+    if (BILINEAR==filter) return bilinear((int)(lod+.5f), uv);
+    int level = (int)lod;
+    int t = (int)((lod-level)*256.f);
+    TGAColor a = bilinear(level, uv);
+    if (0==t || level+1>=nlevels()) return a;
+    TGAColor b = bilinear(level+1, uv);
+    for (int c=0; c<4; c++) a.bgra[c] = (unsigned char)((a.bgra[c]*256 + (b.bgra[c]-a.bgra[c])*t + 128)>>8);
+    return a;
+}
+
+float Texture::lod(Vec2f duvdx, Vec2f duvdy) const {
+    float w = get_width(), h = get_height();
+    float dx = (duvdx.x*w)*(duvdx.x*w) + (duvdx.y*h)*(duvdx.y*h);
+    float dy = (duvdy.x*w)*(duvdy.x*w) + (duvdy.y*h)*(duvdy.y*h);
+    return .5f*std::log2(std::max(std::max(dx, dy), 1e-12f)); // log2 of the texel footprint of a pixel
+}
+
+void uv_derivatives(const Vec2f s[3], const Vec2f uv[3], Vec2f &duvdx, Vec2f &duvdy) {
+    float area = (s[1].x-s[0].x)*(s[2].y-s[0].y) - (s[2].x-s[0].x)*(s[1].y-s[0].y);
+    duvdx = duvdy = Vec2f(0, 0);
+    if (std::abs(area)<1e-6f) return;
+    for (int i=0; i<3; i++) { // barycentric coordinate i is a*x + b*y + c, see setup_triangle()
+        const Vec2f &p = s[(i+1)%3], &q = s[(i+2)%3];
+        duvdx = duvdx + uv[i]*((p.y-q.y)/area);
+        duvdy = duvdy + uv[i]*((q.x-p.x)/area);
+    }
+}
+
@@ -1,148 +1,274 @@
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <algorithm>
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "tgaimage.h"
+#include "mappedfile.h"
+#include "threadpool.h"
 
-TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
+TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0), pool(NULL), owned(true) {
 }
 
-TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(w), height(h), bytespp(bpp) {
+TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(w), height(h), bytespp(bpp), pool(NULL), owned(true) {
     unsigned long nbytes = width*height*bytespp;
-    data = new unsigned char[nbytes];
+    data = allocate(nbytes);
     memset(data, 0, nbytes);
 }
 
-TGAImage::TGAImage(const TGAImage &img) : data(NULL), width(img.width), height(img.height), bytespp(img.bytespp) {
+TGAImage::TGAImage(int w, int h, int bpp, FramebufferPool &fbpool) : data(NULL), width(w), height(h), bytespp(bpp), pool(&fbpool), owned(true) {
     unsigned long nbytes = width*height*bytespp;
-    data = new unsigned char[nbytes];
-    memcpy(data, img.data, nbytes);
+    data = allocate(nbytes);
+    memset(data, 0, nbytes);
+}
+
+TGAImage::TGAImage(const TGAImage &img) : data(NULL), width(img.width), height(img.height), bytespp(img.bytespp), pool(img.pool), owned(true) {
+    unsigned long nbytes = width*height*bytespp;
+    data = allocate(nbytes);
+    if (img.data) memcpy(data, img.data, nbytes);
+}
+
+TGAImage::TGAImage(TGAImage &&img) : data(img.data), width(img.width), height(img.height), bytespp(img.bytespp), pool(img.pool), owned(img.owned) {
+    img.data = NULL;
+    img.width = img.height = img.bytespp = 0;
+    img.owned = true;
 }
 
 TGAImage::~TGAImage() {
-    if (data) delete [] data;
+    release();
+}
+
+unsigned char *TGAImage::allocate(unsigned long nbytes) {
+    return pool ? pool->acquire(nbytes) : aligned_pixels(nbytes);
+}
+
+void TGAImage::release() {
+    if (data && owned) {
+        if (pool) pool->release(data);
+        else free_aligned_pixels(data);
+    }
+    data = NULL;
+    owned = true; // whatever comes next is ours
 }
 
 TGAImage & TGAImage::operator =(const TGAImage &img) {
     if (this != &img) {
-        if (data) delete [] data;
+        release();
         width  = img.width;
         height = img.height;
         bytespp = img.bytespp;
         unsigned long nbytes = width*height*bytespp;
-        data = new unsigned char[nbytes];
-        memcpy(data, img.data, nbytes);
+        data = allocate(nbytes);
+        if (img.data) memcpy(data, img.data, nbytes);
     }
     return *this;
 }
 
+TGAImage & TGAImage::operator =(TGAImage &&img) {
+    if (this != &img) {
+        release();
+        data    = img.data;
+        width   = img.width;
+        height  = img.height;
+        bytespp = img.bytespp;
+        pool    = img.pool;
+        owned   = img.owned;
+        img.data = NULL;
+        img.width = img.height = img.bytespp = 0;
+        img.owned = true;
+    }
+    return *this;
+}
+
+TGAView::TGAView(unsigned char *pixels, int w, int h, int bpp) : TGAImage() {
+    data    = pixels;
+    width   = w;
+    height  = h;
+    bytespp = bpp;
+    owned   = false;
+}
+
+TGAView::TGAView(TGAImage &img) : TGAView(img.buffer(), img.get_width(), img.get_height(), img.get_bytespp()) {
+}
+
+TGAView::TGAView(const TGAView &view) : TGAView(view.data, view.width, view.height, view.bytespp) {
+}
+
+TGAView & TGAView::operator =(const TGAView &view) {
+    if (this != &view) {
+        release();
+        data    = view.data;
+        width   = view.width;
+        height  = view.height;
+        bytespp = view.bytespp;
+        owned   = false;
+    }
+    return *this;
+}
+
+TGAView & TGAView::operator =(const TGAImage &img) {
+    TGAImage::operator =(img);
+    return *this;
+}
+
 bool TGAImage::read_tga_file(const char *filename) {
-    if (data) delete [] data;
-    data = NULL;
-    std::ifstream in;
-    in.open (filename, std::ios::binary);
-    if (!in.is_open()) {
+    release();
+    MappedFile file;
+    if (!file.open(filename)) {
         std::cerr << "can't open file " << filename << "\n";
-        in.close();
         return false;
     }
+    const unsigned char *in  = (const unsigned char *)file.data();
+    const unsigned char *end = in + file.size();
     TGA_Header header;
-    in.read((char *)&header, sizeof(header));
-    if (!in.good()) {
-        in.close();
+    if (file.size()<sizeof(header)) {
         std::cerr << "an error occured while reading the header\n";
         return false;
     }
+    memcpy((void *)&header, in, sizeof(header));
+    in += sizeof(header) + (unsigned char)header.idlength;
     width   = header.width;
     height  = header.height;
     bytespp = header.bitsperpixel>>3;
     if (width<=0 || height<=0 || (bytespp!=GRAYSCALE && bytespp!=RGB && bytespp!=RGBA)) {
-        in.close();
         std::cerr << "bad bpp (or width/height) value\n";
         return false;
     }
     unsigned long nbytes = bytespp*width*height;
-    data = new unsigned char[nbytes];
+    data = allocate(nbytes);
+    bool bottom_up = !(header.imagedescriptor & 0x20);
     if (3==header.datatypecode || 2==header.datatypecode) {
-        in.read((char *)data, nbytes);
-        if (!in.good()) {
-            in.close();
+        if (in>end || (unsigned long)(end-in)<nbytes) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
+        unsigned long bytes_per_line = width*bytespp;
+        for (int j=0; j<height; j++) // the vertical flip is folded into the copy
+            memcpy(data+(bottom_up ? height-1-j : j)*bytes_per_line, in+j*bytes_per_line, bytes_per_line);
+        bottom_up = false;
     } else if (10==header.datatypecode||11==header.datatypecode) {
-        if (!load_rle_data(in)) {
-            in.close();
+        if (in>end || !load_rle_data(in, end-in)) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
     } else {
-        in.close();
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return false;
     }
-    if (!(header.imagedescriptor & 0x20)) {
+    if (bottom_up) {
         flip_vertically();
     }
     if (header.imagedescriptor & 0x10) {
         flip_horizontally();
     }
     std::cerr << width << "x" << height << "/" << bytespp*8 << "\n";
-    in.close();
     return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
-    unsigned long pixelcount = width*height;
-    unsigned long currentpixel = 0;
-    unsigned long currentbyte  = 0;
-    TGAColor colorbuffer;
-    do {
-        unsigned char chunkheader = 0;
-        chunkheader = in.get();
-        if (!in.good()) {
+// packets may cross scanlines, the runs are filled by doubling the copied span
+bool TGAImage::load_rle_data(const unsigned char *in, size_t size) {
+    const unsigned char *end = in+size;
+    unsigned long nbytes = width*height*bytespp;
+    unsigned long currentbyte = 0;
+    while (currentbyte<nbytes) {
+        if (in>=end) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
+        unsigned char chunkheader = *in++;
+        unsigned long count = (chunkheader<128 ? chunkheader+1 : chunkheader-127)*bytespp;
+        if (currentbyte+count>nbytes) {
+            std::cerr << "Too many pixels read\n";
+            return false;
+        }
+        unsigned long nread = chunkheader<128 ? count : bytespp;
+        if ((unsigned long)(end-in)<nread) {
+            std::cerr << "an error occured while reading the header\n";
+            return false;
+        }
+        unsigned char *dst = data+currentbyte;
         if (chunkheader<128) {
-            chunkheader++;
-            for (int i=0; i<chunkheader; i++) {
-                in.read((char *)colorbuffer.bgra, bytespp);
-                if (!in.good()) {
-                    std::cerr << "an error occured while reading the header\n";
-                    return false;
-                }
-                for (int t=0; t<bytespp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel>pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
-            }
+            memcpy(dst, in, count);
+        } else if (1==bytespp) {
+            memset(dst, *in, count);
         } else {
-            chunkheader -= 127;
-            in.read((char *)colorbuffer.bgra, bytespp);
-            if (!in.good()) {
-                std::cerr << "an error occured while reading the header\n";
-                return false;
-            }
-            for (int i=0; i<chunkheader; i++) {
-                for (int t=0; t<bytespp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel>pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
-            }
+            memcpy(dst, in, bytespp);
+            for (unsigned long filled=bytespp; filled<count; filled*=2)
+                memcpy(dst+filled, dst, std::min(filled, count-filled));
         }
-    } while (currentpixel < pixelcount);
+        in += nread;
+        currentbyte += count;
+    }
     return true;
 }
 
-bool TGAImage::write_tga_file(const char *filename, bool rle) {
+// Length of the span starting at pixel i where "pixel k equals pixel k+1" is the same as for k=i, capped to
+// maxlen pairs. Two pixels are equal when all their bytes are, so the SSE2 path compares the pixels with themselves
+// shifted by one pixel, 16/bpp pixels at a time, and keeps the bits of the fully equal pixels.
+static int span_length(const unsigned char *pixels, int npairs, int bpp, int i, bool equal, int maxlen) {
+    int n = std::min(npairs, i+maxlen);
+    int k = i;
+#if defined(__SSE2__)
+    const int step = 16/bpp;
+    int pixmask = 0;
+    for (int p=0; p<step; p++) pixmask |= 1<<(p*bpp);
+    long limit = (long)npairs*bpp - 16; // the last byte read is (k*bpp+bpp+15), there are (npairs+1)*bpp
+    for (; k+step<=n && (long)k*bpp<=limit; k+=step) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(pixels+k*bpp));
+        __m128i b = _mm_loadu_si128((const __m128i *)(pixels+k*bpp+bpp));
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+        int all = m;
+        for (int t=1; t<bpp; t++) all &= m>>t;
+        int hit = (equal ? ~all : all) & pixmask; // the pixels that end the span
+        if (hit) return k + __builtin_ctz(hit)/bpp - i;
+    }
+#endif
+    for (; k<n; k++) {
+        if ((0==memcmp(pixels+k*bpp, pixels+k*bpp+bpp, bpp))!=equal) break;
+    }
+    return k-i;
+}
+
+// Splitting a raw packet for a run of two costs 1+bpp bytes against 2*bpp, plus one header to resume the
+// raw packet after it: it pays off for bpp>1 only. For grayscale a pair of equal
+// pixels stays in the raw packet, unless no raw packet is open and another run follows it.
+static void encode_rle(const unsigned char *pixels, int npixels, int bpp, std::vector<unsigned char> &out) {
+    const int max_chunk_length = 128;
+    const int min_run = 1==bpp ? 3 : 2;
+    int npairs = npixels-1;
+    int i = 0;
+    while (i<npixels) {
+        int run = 1 + span_length(pixels, npairs, bpp, i, true, max_chunk_length-1);
+        bool pair_before_run = 2==run && i+2<npixels && span_length(pixels, npairs, bpp, i+2, true, 1)>0;
+        if (run>=min_run || pair_before_run) {
+            out.push_back(run+127);
+            out.insert(out.end(), pixels+i*bpp, pixels+i*bpp+bpp);
+            i += run;
+            continue;
+        }
+        int j = i; // the raw packet is [i, j)
+        int end = std::min(npixels, i+max_chunk_length);
+        while (j<end) {
+            j += span_length(pixels, npairs, bpp, j, false, end-j); // next pixel equal to its successor
+            if (j>=end || j>=npairs) {
+                j = end;
+                break;
+            }
+            if (1+span_length(pixels, npairs, bpp, j, true, min_run-1)>=min_run) break;
+            j++;
+        }
+        out.push_back(j-i-1);
+        out.insert(out.end(), pixels+i*bpp, pixels+j*bpp);
+        i = j;
+    }
+}
+
+bool TGAImage::write_tga_file(const char *filename, bool rle, bool flip) {
     unsigned char developer_area_ref[4] = {0, 0, 0, 0};
     unsigned char extension_area_ref[4] = {0, 0, 0, 0};
     unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
@@ -159,7 +285,7 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
     header.width  = width;
     header.height = height;
     header.datatypecode = (bytespp==GRAYSCALE?(rle?11:3):(rle?10:2));
-    header.imagedescriptor = 0x20; // top-left origin
+    header.imagedescriptor = flip ? 0x00 : 0x20; // bottom-left or top-left origin, no pass over the pixels either way
     out.write((char *)&header, sizeof(header));
     if (!out.good()) {
         out.close();
@@ -181,17 +307,7 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
         }
     }
     out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
     out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
     out.write((char *)footer, sizeof(footer));
     if (!out.good()) {
         std::cerr << "can't dump the tga file\n";
@@ -202,41 +318,20 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
     return true;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
+// bands of rows are encoded concurrently into their own buffers, then written in order; packets may cross
+// rows (as they always did in this writer) but not band boundaries
 bool TGAImage::unload_rle_data(std::ofstream &out) {
-    const unsigned char max_chunk_length = 128;
-    unsigned long npixels = width*height;
-    unsigned long curpix = 0;
-    while (curpix<npixels) {
-        unsigned long chunkstart = curpix*bytespp;
-        unsigned long curbyte = curpix*bytespp;
-        unsigned char run_length = 1;
-        bool raw = true;
-        while (curpix+run_length<npixels && run_length<max_chunk_length) {
-            bool succ_eq = true;
-            for (int t=0; succ_eq && t<bytespp; t++) {
-                succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
-            }
-            curbyte += bytespp;
-            if (1==run_length) {
-                raw = !succ_eq;
-            }
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq) {
-                break;
-            }
-            run_length++;
-        }
-        curpix += run_length;
-        out.put(raw?run_length-1:run_length+127);
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
-        }
-        out.write((char *)(data+chunkstart), (raw?run_length*bytespp:bytespp));
+    if (!data) return false;
+    ThreadPool &pool = ThreadPool::shared();
+    int nbands = std::max(1, std::min(height, pool.size()*4));
+    std::vector<std::vector<unsigned char> > bands(nbands);
+    pool.parallel_for(nbands, [&](int b) {
+        int y0 = (long)b*height/nbands, y1 = (long)(b+1)*height/nbands;
+        bands[b].reserve((unsigned long)(y1-y0)*(width*bytespp + (width+127)/128));
+        encode_rle(data+(unsigned long)y0*width*bytespp, (y1-y0)*width, bytespp, bands[b]);
+    });
+    for (int b=0; b<nbands; b++) {
+        out.write((char *)bands[b].data(), bands[b].size());
         if (!out.good()) {
             std::cerr << "can't dump the tga file\n";
             return false;
@@ -320,7 +415,7 @@ void TGAImage::clear() {
 
 bool TGAImage::scale(int w, int h) {
     if (w<=0 || h<=0 || !data) return false;
-    unsigned char *tdata = new unsigned char[w*h*bytespp];
+    unsigned char *tdata = allocate(w*h*bytespp);
     int nscanline = 0;
     int oscanline = 0;
     int erry = 0;
@@ -348,7 +443,7 @@ bool TGAImage::scale(int w, int h) {
             nscanline += nlinebytes;
         }
     }
-    delete [] data;
+    release();
     data = tdata;
     width = w;
     height = h;
@@ -0,0 +1,103 @@
+#include "threadpool.h"
+
+static thread_local const ThreadPool *running_pool = NULL; // set while a thread executes tasks of a pool
+
+ThreadPool::ThreadPool(int nthreads) : threads_(), queues_(), submit_(), mutex_(), wake_(), done_(), task_(NULL), generation_(0), busy_(0), quit_(false) {
+    if (nthreads<=0) nthreads = std::thread::hardware_concurrency();
+    if (nthreads<=0) nthreads = 1;
+    for (int i=0; i<nthreads; i++)
+        queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+    for (int i=0; i<nthreads-1; i++)
+        threads_.push_back(std::thread(&ThreadPool::worker, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i=0; i<threads_.size(); i++) threads_[i].join();
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+int ThreadPool::size() const {
+    return (int)queues_.size();
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int)> &task) {
+    if (n<=0) return;
+    if (running_pool==this || 1==size() || 1==n) { // nested call or nothing to share: stay on this thread
+        for (int i=0; i<n; i++) task(i);
+        return;
+    }
+    std::lock_guard<std::mutex> submit(submit_);
+    int nqueues = size();
+    for (int q=0; q<nqueues; q++) {
+        std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+        for (int i=(long)q*n/nqueues; i<(long)(q+1)*n/nqueues; i++)
+            queues_[q]->items.push_back(i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        generation_++;
+    }
+    wake_.notify_all();
+    run(nqueues-1, task);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return 0==busy_; });
+    task_ = NULL;
+}
+
+void ThreadPool::worker(int id) {
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this, seen]() { return quit_ || (task_ && generation_!=seen); });
+        if (quit_) return;
+        seen = generation_;
+        const std::function<void(int)> *task = task_;
+        busy_++;
+        lock.unlock();
+        run(id, *task);
+        lock.lock();
+        if (0==--busy_) done_.notify_all();
+    }
+}
+
+void ThreadPool::run(int id, const std::function<void(int)> &task) {
+    const ThreadPool *outer = running_pool;
+    running_pool = this;
+    int item;
+    while (pop(id, item)) task(item);
+    running_pool = outer;
+}
+
+bool ThreadPool::pop(int id, int &item) {
+    {
+        Queue &own = *queues_[id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty()) {
+            item = own.items.front();
+            own.items.pop_front();
+            return true;
+        }
+    }
+    int nqueues = size();
+    for (int i=1; i<nqueues; i++) { // nothing left in our own block, steal from the back of someone else's
+        Queue &victim = *queues_[(id+i)%nqueues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            item = victim.items.back();
+            victim.items.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+